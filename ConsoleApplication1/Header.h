@@ -2,8 +2,51 @@
 
 #include "std_.h"
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 // general utilities
 namespace tests{
+	// Segmented iterators (Austern): a container stored as a chain of
+	// contiguous blocks specializes this to expose the blocks, so algorithms
+	// can run plain pointer loops inside each one and only step between
+	// blocks at their edges. compose must turn the end of a block into the
+	// start of the next.
+	template<typename It>
+	struct segmented_iterator_traits {
+		using is_segmented_iterator = std::false_type;
+	};
+
+	template<typename It>
+	using is_segmented_iterator =
+		typename tests::segmented_iterator_traits<It>::is_segmented_iterator;
+
+	// calls f(local_first, local_last) on each block of [first, last)
+	template<typename SegIt, typename Function>
+	void for_each_segment(SegIt first, SegIt last, Function f) {
+		using traits = tests::segmented_iterator_traits<SegIt>;
+		auto seg = traits::segment(first);
+		auto last_seg = traits::segment(last);
+		if (seg == last_seg) {
+			f(traits::local(first), traits::local(last));
+			return;
+		}
+
+		f(traits::local(first), traits::end(seg));
+		for (seg = traits::next_segment(seg); seg != last_seg; seg = traits::next_segment(seg))
+			f(traits::begin(seg), traits::end(seg));
+		f(traits::begin(last_seg), traits::local(last));
+	}
+
 	template<typename RanIt>
 	auto distance_impl(RanIt begin, RanIt end, tests::random_access_iterator_tag) {
 		return end - begin;
@@ -17,10 +60,25 @@ namespace tests{
 	}
 
 	template<typename InputIt>
-	auto distance(InputIt begin, InputIt end) {
+	auto distance_impl(InputIt begin, InputIt end, std::false_type) {
 		return distance_impl(begin, end, tests::iterator_traits<InputIt>::iterator_category{});
 	}
 
+	// sums block sizes instead of walking elements
+	template<typename SegIt>
+	auto distance_impl(SegIt begin, SegIt end, std::true_type) {
+		typename tests::iterator_traits<SegIt>::difference_type dist = 0;
+		tests::for_each_segment(begin, end, [&dist](auto first, auto last) {
+			dist += last - first;
+		});
+		return dist;
+	}
+
+	template<typename InputIt>
+	auto distance(InputIt begin, InputIt end) {
+		return distance_impl(begin, end, tests::is_segmented_iterator<InputIt>{});
+	}
+
 	template<typename RanIt, typename diff_type>
 	void advance_impl(RanIt& it, const diff_type& n, tests::random_access_iterator_tag) {
 		it += n;
@@ -32,10 +90,30 @@ namespace tests{
 	}
 
 	template<typename InputIt, typename diff_type>
-	void advance(InputIt& it, const diff_type& n) {
+	void advance_impl(InputIt& it, const diff_type& n, std::false_type) {
 		advance_impl(it, n, tests::iterator_traits<InputIt>::iterator_category{});
 	}
 
+	// skips whole blocks by their sizes; n must not be negative
+	template<typename SegIt, typename diff_type>
+	void advance_impl(SegIt& it, const diff_type& n, std::true_type) {
+		using traits = tests::segmented_iterator_traits<SegIt>;
+		auto seg = traits::segment(it);
+		auto local = traits::local(it);
+		diff_type rest = n;
+		while (rest > static_cast<diff_type>(traits::end(seg) - local)) {
+			rest -= static_cast<diff_type>(traits::end(seg) - local);
+			seg = traits::next_segment(seg);
+			local = traits::begin(seg);
+		}
+		it = traits::compose(seg, local + rest);
+	}
+
+	template<typename InputIt, typename diff_type>
+	void advance(InputIt& it, const diff_type& n) {
+		advance_impl(it, n, tests::is_segmented_iterator<InputIt>{});
+	}
+
 	template<typename ForwardIt,
 		typename diff_type = tests::iterator_traits<ForwardIt>::difference_type>
 		ForwardIt next(ForwardIt it, diff_type diff = 1) {
@@ -49,69 +127,697 @@ namespace tests{
 			return a < b;
 		}
 	};
+
+	// projections are callables or, as in the ranges library, pointers to
+	// data members
+	template<typename Projection>
+	Projection make_projection(Projection proj) {
+		return proj;
+	}
+
+	template<typename T, typename C>
+	auto make_projection(T C::* member) {
+		return std::mem_fn(member);
+	}
+
+	template<typename Projection>
+	using projection_t = decltype(tests::make_projection(std::declval<Projection>()));
+
+	// whether proj can be applied to the elements of It; keeps the projection
+	// overloads from taking calls such as merge_sort(first, last, buffer, 16)
+	template<typename Projection, typename It, typename = void>
+	struct is_projection : std::false_type {};
+
+	template<typename Projection, typename It>
+	struct is_projection<Projection, It, decltype(void(
+		std::declval<tests::projection_t<Projection>&>()(*std::declval<It&>())))> :
+		std::true_type {};
+
+	template<typename Projection, typename It, typename T = void>
+	using enable_if_projection_t = std::enable_if_t<tests::is_projection<Projection, It>::value, T>;
+
+	// orders elements by comp on their projections
+	template<typename Compare, typename Projection>
+	struct projected_compare {
+		Compare comp;
+		Projection proj;
+
+		template<typename T>
+		bool operator()(const T& a, const T& b) const {
+			return comp(proj(a), proj(b));
+		}
+	};
+
+	template<typename Compare, typename Projection>
+	auto make_projected_compare(Compare comp, Projection proj) {
+		return projected_compare<Compare, tests::projection_t<Projection>>{
+			comp, tests::make_projection(proj) };
+	}
+
+	// reusable scratch memory: grows geometrically, never shrinks, and counts
+	// how often it had to go to the heap, so steady-state callers can check it
+	// stays put
+	class scratch_arena {
+	public:
+		scratch_arena() : storage(nullptr), capacity(0), allocation_count(0) {}
+
+		explicit scratch_arena(std::size_t bytes) : scratch_arena() {
+			reserve(bytes);
+		}
+
+		scratch_arena(const scratch_arena&) = delete;
+		scratch_arena& operator=(const scratch_arena&) = delete;
+
+		~scratch_arena() {
+			::operator delete(storage);
+		}
+
+		void reserve(std::size_t bytes) {
+			if (bytes <= capacity)
+				return;
+
+			std::size_t grown = capacity * 2;
+			if (grown < bytes)
+				grown = bytes;
+
+			::operator delete(storage);
+			storage = nullptr;
+			capacity = 0;
+			storage = ::operator new(grown);
+			capacity = grown;
+			++allocation_count;
+		}
+
+		// the previous contents are not preserved across a call that grows
+		template<typename T>
+		T* get(std::size_t n) {
+			reserve(n * sizeof(T));
+			return static_cast<T*>(storage);
+		}
+
+		std::size_t size() const { return capacity; }
+		std::size_t allocations() const { return allocation_count; }
+
+	private:
+		void* storage;
+		std::size_t capacity;
+		std::size_t allocation_count;
+	};
+
+	// raw storage for a fixed number of elements, constructed in order through
+	// push_back, so scratch space never default-constructs or copies
+	template<typename T>
+	class uninitialized_buffer {
+	public:
+		using value_type = T;
+
+		explicit uninitialized_buffer(std::size_t capacity) :
+			storage(static_cast<T*>(::operator new(capacity * sizeof(T)))),
+			limit(capacity),
+			count(0),
+			owner(true) {
+		}
+
+		// capacity() is 0 if the storage couldn't be had
+		uninitialized_buffer(std::size_t capacity, const std::nothrow_t&) :
+			storage(static_cast<T*>(::operator new(capacity * sizeof(T), std::nothrow))),
+			limit(storage ? capacity : 0),
+			count(0),
+			owner(true) {
+		}
+
+		// borrows storage, e.g. from a scratch_arena or the caller
+		uninitialized_buffer(T* _storage, std::size_t _capacity) :
+			storage(_storage),
+			limit(_capacity),
+			count(0),
+			owner(false) {
+		}
+
+		uninitialized_buffer(const uninitialized_buffer&) = delete;
+		uninitialized_buffer& operator=(const uninitialized_buffer&) = delete;
+
+		~uninitialized_buffer() {
+			clear();
+			if (owner)
+				::operator delete(storage);
+		}
+
+		void push_back(const T& x) {
+			::new (static_cast<void*>(storage + count)) T(x);
+			++count;
+		}
+
+		void push_back(T&& x) {
+			::new (static_cast<void*>(storage + count)) T(std::move(x));
+			++count;
+		}
+
+		void clear() {
+			for (std::size_t i = 0; i < count; ++i)
+				storage[i].~T();
+			count = 0;
+		}
+
+		T* begin() { return storage; }
+		T* end() { return storage + count; }
+
+		std::size_t capacity() const { return limit; }
+
+	private:
+		T* storage;
+		std::size_t limit;
+		std::size_t count;
+		bool owner;
+	};
+}
+
+// algorithms // non-modifying sequence operations
+namespace tests {
+	template<typename InputIt, typename UnaryFunction>
+	void for_each_impl(InputIt begin, InputIt end, UnaryFunction& f, std::false_type) {
+		for (; begin != end; ++begin)
+			f(*begin);
+	}
+
+	template<typename SegIt, typename UnaryFunction>
+	void for_each_impl(SegIt begin, SegIt end, UnaryFunction& f, std::true_type) {
+		tests::for_each_segment(begin, end, [&f](auto first, auto last) {
+			tests::for_each_impl(first, last, f, std::false_type{});
+		});
+	}
+
+	template<typename InputIt, typename UnaryFunction>
+	UnaryFunction for_each(InputIt begin, InputIt end, UnaryFunction f) {
+		tests::for_each_impl(begin, end, f, tests::is_segmented_iterator<InputIt>{});
+		return f;
+	}
+
+	template<typename InputIt, typename UnaryPredicate>
+	typename tests::iterator_traits<InputIt>::difference_type
+		count_if_impl(InputIt begin, InputIt end, UnaryPredicate& pred, std::false_type) {
+		typename tests::iterator_traits<InputIt>::difference_type res = 0;
+		for (; begin != end; ++begin)
+			if (pred(*begin))
+				++res;
+		return res;
+	}
+
+	template<typename SegIt, typename UnaryPredicate>
+	typename tests::iterator_traits<SegIt>::difference_type
+		count_if_impl(SegIt begin, SegIt end, UnaryPredicate& pred, std::true_type) {
+		typename tests::iterator_traits<SegIt>::difference_type res = 0;
+		tests::for_each_segment(begin, end, [&res, &pred](auto first, auto last) {
+			res += tests::count_if_impl(first, last, pred, std::false_type{});
+		});
+		return res;
+	}
+
+	template<typename InputIt, typename UnaryPredicate>
+	typename tests::iterator_traits<InputIt>::difference_type
+		count_if(InputIt begin, InputIt end, UnaryPredicate pred) {
+		return tests::count_if_impl(begin, end, pred, tests::is_segmented_iterator<InputIt>{});
+	}
 }
 
 // algorithms // binary search operations
 namespace tests {
 	template<typename ForwardIt, typename T, typename Compare>
-	ForwardIt lower_bound(ForwardIt first, ForwardIt last,
-		const T& key, Compare comp) {
+	ForwardIt lower_bound_impl(ForwardIt first, ForwardIt last,
+		const T& key, Compare comp, std::false_type) {
+		// the remaining length is tracked, not re-measured, so forward
+		// iterators walk O(n) in total instead of O(n) per step
 		auto dist = tests::distance(first, last);
 		while (dist) {
-			ForwardIt mid = first;
-			tests::advance(mid, dist / 2);
-			if (comp(*mid, key))
+			auto half = dist / 2;
+			ForwardIt mid = tests::next(first, half);
+			if (comp(*mid, key)) {
 				first = tests::next(mid);
-			else
-				last = mid;
+				dist -= half + 1;
+			}
+			else {
+				dist = half;
+			}
+		}
+		return first;
+	}
 
-			dist = tests::distance(first, last);
+	// halves across blocks until the rest fits in one, then searches that
+	// block through raw pointers
+	template<typename SegIt, typename T, typename Compare>
+	SegIt lower_bound_impl(SegIt first, SegIt last, const T& key, Compare comp,
+		std::true_type) {
+		using traits = tests::segmented_iterator_traits<SegIt>;
+		auto dist = tests::distance(first, last);
+		while (dist) {
+			auto seg = traits::segment(first);
+			auto local = traits::local(first);
+			if (traits::end(seg) - local >= dist)
+				return traits::compose(seg,
+					tests::lower_bound_impl(local, local + dist, key, comp, std::false_type{}));
+
+			auto half = dist / 2;
+			SegIt mid = tests::next(first, half);
+			if (comp(*mid, key)) {
+				first = tests::next(mid);
+				dist -= half + 1;
+			}
+			else {
+				dist = half;
+			}
 		}
 		return first;
 	}
 
+	template<typename ForwardIt, typename T, typename Compare>
+	ForwardIt lower_bound(ForwardIt first, ForwardIt last, const T& key, Compare comp) {
+		return tests::lower_bound_impl(first, last, key, comp,
+			tests::is_segmented_iterator<ForwardIt>{});
+	}
+
 	template<typename ForwardIt, typename T>
 	ForwardIt lower_bound(ForwardIt begin, ForwardIt end, const T& value) {
 		return tests::lower_bound(begin, end, value, tests::less<T>{});
 	}
 
 	template<typename ForwardIt, typename T, typename Compare>
-	ForwardIt upper_bound(ForwardIt first, ForwardIt last,
-		const T& key, Compare comp) {
+	ForwardIt upper_bound_impl(ForwardIt first, ForwardIt last,
+		const T& key, Compare comp, std::false_type) {
 		auto dist = tests::distance(first, last);
 		while (dist) {
-			ForwardIt mid = first;
-			tests::advance(mid, dist / 2);
-			if (comp(key, *mid))
-				last = mid;
-			else
+			auto half = dist / 2;
+			ForwardIt mid = tests::next(first, half);
+			if (comp(key, *mid)) {
+				dist = half;
+			}
+			else {
 				first = tests::next(mid);
+				dist -= half + 1;
+			}
+		}
+		return first;
+	}
+
+	template<typename SegIt, typename T, typename Compare>
+	SegIt upper_bound_impl(SegIt first, SegIt last, const T& key, Compare comp,
+		std::true_type) {
+		using traits = tests::segmented_iterator_traits<SegIt>;
+		auto dist = tests::distance(first, last);
+		while (dist) {
+			auto seg = traits::segment(first);
+			auto local = traits::local(first);
+			if (traits::end(seg) - local >= dist)
+				return traits::compose(seg,
+					tests::upper_bound_impl(local, local + dist, key, comp, std::false_type{}));
 
-			dist = tests::distance(first, last);
+			auto half = dist / 2;
+			SegIt mid = tests::next(first, half);
+			if (comp(key, *mid)) {
+				dist = half;
+			}
+			else {
+				first = tests::next(mid);
+				dist -= half + 1;
+			}
 		}
 		return first;
 	}
 
+	template<typename ForwardIt, typename T, typename Compare>
+	ForwardIt upper_bound(ForwardIt first, ForwardIt last, const T& key, Compare comp) {
+		return tests::upper_bound_impl(first, last, key, comp,
+			tests::is_segmented_iterator<ForwardIt>{});
+	}
+
 	template<typename ForwardIt, typename T>
 	ForwardIt upper_bound(ForwardIt begin, ForwardIt end, const T& value) {
 		return tests::upper_bound(begin, end, value, tests::less<T>{});
 	}
 
+	// everything lower_bound, upper_bound, binary_search and count report
+	template<typename ForwardIt>
+	struct search_result {
+		ForwardIt lower;
+		ForwardIt upper;
+		bool found;
+		typename tests::iterator_traits<ForwardIt>::difference_type count;
+	};
+
+	// one descent while the key is outside the probed range; the first probe
+	// equal to the key splits it into a lower_bound on the left half and an
+	// upper_bound on the right, so no level is searched twice
+	template<typename ForwardIt, typename T, typename Compare>
+	search_result<ForwardIt> equal_range_query(ForwardIt first, ForwardIt last,
+		const T& key, Compare comp) {
+		auto dist = tests::distance(first, last);
+		while (dist) {
+			auto half = dist / 2;
+			ForwardIt mid = tests::next(first, half);
+			if (comp(*mid, key)) {
+				first = tests::next(mid);
+				dist -= half + 1;
+			}
+			else if (comp(key, *mid)) {
+				dist = half;
+			}
+			else {
+				auto lower = tests::lower_bound(first, mid, key, comp);
+				auto upper = tests::upper_bound(tests::next(mid),
+					tests::next(first, dist), key, comp);
+				return{ lower, upper, true, tests::distance(lower, upper) };
+			}
+		}
+		return{ first, first, false, 0 };
+	}
+
+	template<typename ForwardIt, typename T>
+	search_result<ForwardIt> equal_range_query(ForwardIt first, ForwardIt last,
+		const T& key) {
+		return tests::equal_range_query(first, last, key, tests::less<T>{});
+	}
+
+	template<typename ForwardIt, typename T, typename Compare>
+	tests::pair<ForwardIt, ForwardIt> equal_range(ForwardIt begin, ForwardIt end,
+		const T& value, Compare comp) {
+		auto res = tests::equal_range_query(begin, end, value, comp);
+		return{ res.lower, res.upper };
+	}
+
 	template<typename ForwardIt, typename T>
 	tests::pair<ForwardIt, ForwardIt> equal_range(ForwardIt begin, ForwardIt end, 
 		const T& value) {
-		return{
-			tests::lower_bound(begin, end, value, tests::less<T>{}),
-			tests::upper_bound(begin, end, value, tests::less<T>{}),
-		};
+		return tests::equal_range(begin, end, value, tests::less<T>{});
+	}
+
+	template<typename ForwardIt, typename T, typename Compare>
+	bool binary_search(ForwardIt begin, ForwardIt end, const T& value, Compare comp) {
+		auto it = tests::lower_bound(begin, end, value, comp);
+		if (it == end)
+			return false;
+		return !comp(value, *it);
 	}
 
 	template<typename ForwardIt, typename T>
 	bool binary_search(ForwardIt begin, ForwardIt end, const T& value) {
-		auto it = tests::lower_bound(begin, end, value, tests::less<T>{});
-		if (it == end)
+		return tests::binary_search(begin, end, value, tests::less<T>{});
+	}
+
+	// searches by comp between key and proj(element), e.g. proj = &item::key
+	template<typename ForwardIt, typename T, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt, ForwardIt> lower_bound(ForwardIt first,
+		ForwardIt last, const T& key, Compare comp, Projection proj) {
+		auto p = tests::make_projection(proj);
+		return tests::lower_bound(first, last, key, [&comp, &p](const auto& x, const T& k) {
+			return comp(p(x), k);
+		});
+	}
+
+	template<typename ForwardIt, typename T, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt, ForwardIt> upper_bound(ForwardIt first,
+		ForwardIt last, const T& key, Compare comp, Projection proj) {
+		auto p = tests::make_projection(proj);
+		return tests::upper_bound(first, last, key, [&comp, &p](const T& k, const auto& x) {
+			return comp(k, p(x));
+		});
+	}
+
+	template<typename ForwardIt, typename T, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt, tests::pair<ForwardIt, ForwardIt>>
+		equal_range(ForwardIt first, ForwardIt last, const T& key, Compare comp, Projection proj) {
+		auto lower = tests::lower_bound(first, last, key, comp, proj);
+		return{ lower, tests::upper_bound(lower, last, key, comp, proj) };
+	}
+
+	template<typename ForwardIt, typename T, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt, bool> binary_search(ForwardIt first,
+		ForwardIt last, const T& key, Compare comp, Projection proj) {
+		auto it = tests::lower_bound(first, last, key, comp, proj);
+		return it != last && !comp(key, tests::make_projection(proj)(*it));
+	}
+
+	// Copies the keys the first levels of every binary search over [first,
+	// last) probe into a small breadth-first array. Queries walk that array
+	// instead of the big one while they are within the cached levels, so the
+	// top of each descent costs no cache misses.
+	template<typename RanIt>
+	class search_cache {
+	public:
+		using value_type = typename tests::iterator_traits<RanIt>::value_type;
+		using difference_type = typename tests::iterator_traits<RanIt>::difference_type;
+
+		search_cache(RanIt _first, RanIt _last, std::size_t levels = 10) :
+			first(_first),
+			size(_last - _first) {
+			// only levels where every node probes an element
+			std::size_t full_levels = 0;
+			while (full_levels < levels
+				&& (difference_type(2) << full_levels) - 1 <= size)
+				++full_levels;
+
+			std::size_t nodes = (std::size_t(1) << full_levels) - 1;
+			std::vector<tests::pair<difference_type, difference_type>> ranges;
+			ranges.reserve(nodes);
+			keys.reserve(nodes);
+			ranges.emplace_back(0, size);
+			for (std::size_t i = 0; i < nodes; ++i) {
+				auto offset = ranges[i].first;
+				auto dist = ranges[i].second;
+				auto half = dist / 2;
+				keys.push_back(first[offset + half]);
+				if (ranges.size() < nodes) {
+					ranges.emplace_back(offset, half);
+					ranges.emplace_back(offset + half + 1, dist - half - 1);
+				}
+			}
+		}
+
+		template<typename T, typename Compare>
+		search_result<RanIt> equal_range_query(const T& key, Compare comp) const {
+			std::size_t node = 0;
+			RanIt lo = first;
+			difference_type dist = size;
+			while (dist) {
+				auto half = dist / 2;
+				RanIt mid = lo + half;
+				const value_type& probe = node < keys.size() ? keys[node] : *mid;
+				if (comp(probe, key)) {
+					lo = mid + 1;
+					dist -= half + 1;
+					node = right(node);
+				}
+				else if (comp(key, probe)) {
+					dist = half;
+					node = left(node);
+				}
+				else {
+					auto lower = lower_bound(left(node), lo, half, key, comp);
+					auto upper = upper_bound(right(node), mid + 1, dist - half - 1, key, comp);
+					return{ lower, upper, true, upper - lower };
+				}
+			}
+			return{ lo, lo, false, 0 };
+		}
+
+		template<typename T>
+		search_result<RanIt> equal_range_query(const T& key) const {
+			return equal_range_query(key, tests::less<T>{});
+		}
+
+	private:
+		// children of uncached nodes stay uncached, without overflowing
+		std::size_t left(std::size_t node) const {
+			return node < keys.size() ? 2 * node + 1 : node;
+		}
+
+		std::size_t right(std::size_t node) const {
+			return node < keys.size() ? 2 * node + 2 : node;
+		}
+
+		template<typename T, typename Compare>
+		RanIt lower_bound(std::size_t node, RanIt lo, difference_type dist,
+			const T& key, Compare comp) const {
+			while (dist) {
+				auto half = dist / 2;
+				RanIt mid = lo + half;
+				if (comp(node < keys.size() ? keys[node] : *mid, key)) {
+					lo = mid + 1;
+					dist -= half + 1;
+					node = right(node);
+				}
+				else {
+					dist = half;
+					node = left(node);
+				}
+			}
+			return lo;
+		}
+
+		template<typename T, typename Compare>
+		RanIt upper_bound(std::size_t node, RanIt lo, difference_type dist,
+			const T& key, Compare comp) const {
+			while (dist) {
+				auto half = dist / 2;
+				RanIt mid = lo + half;
+				if (comp(key, node < keys.size() ? keys[node] : *mid)) {
+					dist = half;
+					node = left(node);
+				}
+				else {
+					lo = mid + 1;
+					dist -= half + 1;
+					node = right(node);
+				}
+			}
+			return lo;
+		}
+
+		RanIt first;
+		difference_type size;
+		std::vector<value_type> keys;
+	};
+}
+
+// sorting networks
+namespace tests {
+	// largest range sort_network accepts
+	constexpr std::size_t sort_network_max = 32;
+
+	// ranges at or below this size finish recursion in sort_network
+	constexpr std::size_t small_sort_threshold = 16;
+
+	template<typename T, typename Compare>
+	void compare_exchange_impl(T& a, T& b, Compare comp, std::true_type) {
+		// branchless: both selects lower to conditional moves for scalars
+		const bool swap = comp(b, a);
+		const T lo = swap ? b : a;
+		const T hi = swap ? a : b;
+		a = lo;
+		b = hi;
+	}
+
+	template<typename T, typename Compare>
+	void compare_exchange_impl(T& a, T& b, Compare comp, std::false_type) {
+		if (comp(b, a)) {
+			using std::swap;
+			swap(a, b);
+		}
+	}
+
+	template<typename T, typename Compare>
+	void compare_exchange(T& a, T& b, Compare comp) {
+		compare_exchange_impl(a, b, comp, std::integral_constant<bool,
+			std::is_arithmetic<T>::value || std::is_pointer<T>::value>{});
+	}
+
+	// Bose-Nelson merge of the sorted blocks [I, I + X) and [J, J + Y)
+	template<std::size_t I, std::size_t X, std::size_t J, std::size_t Y>
+	struct network_merge {
+		static constexpr std::size_t A = X / 2;
+		static constexpr std::size_t B = (X & 1) ? Y / 2 : (Y + 1) / 2;
+
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt first, Compare comp) {
+			network_merge<I, A, J, B>::apply(first, comp);
+			network_merge<I + A, X - A, J + B, Y - B>::apply(first, comp);
+			network_merge<I + A, X - A, J, B>::apply(first, comp);
+		}
+	};
+
+	template<std::size_t I, std::size_t J>
+	struct network_merge<I, 1, J, 1> {
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt first, Compare comp) {
+			tests::compare_exchange(first[I], first[J], comp);
+		}
+	};
+
+	template<std::size_t I, std::size_t J>
+	struct network_merge<I, 1, J, 2> {
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt first, Compare comp) {
+			tests::compare_exchange(first[I], first[J + 1], comp);
+			tests::compare_exchange(first[I], first[J], comp);
+		}
+	};
+
+	template<std::size_t I, std::size_t J>
+	struct network_merge<I, 2, J, 1> {
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt first, Compare comp) {
+			tests::compare_exchange(first[I], first[J], comp);
+			tests::compare_exchange(first[I + 1], first[J], comp);
+		}
+	};
+
+	// Bose-Nelson network sorting [I, I + M)
+	template<std::size_t I, std::size_t M>
+	struct network_sort {
+		static constexpr std::size_t A = M / 2;
+
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt first, Compare comp) {
+			network_sort<I, A>::apply(first, comp);
+			network_sort<I + A, M - A>::apply(first, comp);
+			network_merge<I, A, I + A, M - A>::apply(first, comp);
+		}
+	};
+
+	template<std::size_t I>
+	struct network_sort<I, 0> {
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt, Compare) {}
+	};
+
+	template<std::size_t I>
+	struct network_sort<I, 1> {
+		template<typename RanIt, typename Compare>
+		static void apply(RanIt, Compare) {}
+	};
+
+	template<typename RanIt, typename Compare, std::size_t... N>
+	void sort_network_impl(RanIt first, std::size_t n, Compare comp,
+		std::index_sequence<N...>) {
+		using network_fn = void(*)(RanIt, Compare);
+		static const network_fn networks[] = {
+			&network_sort<0, N>::template apply<RanIt, Compare>... };
+		networks[n](first, comp);
+	}
+
+	// not stable; requires last - first <= sort_network_max
+	template<typename RanIt, typename Compare>
+	void sort_network(RanIt first, RanIt last, Compare comp) {
+		tests::sort_network_impl(first, static_cast<std::size_t>(last - first), comp,
+			std::make_index_sequence<sort_network_max + 1>{});
+	}
+
+	template<typename RanIt>
+	void sort_network(RanIt first, RanIt last) {
+		tests::sort_network(first, last,
+			tests::less<typename tests::iterator_traits<RanIt>::value_type>{});
+	}
+
+	template<typename RanIt, typename Compare>
+	bool sort_leaf_impl(RanIt first, RanIt last, std::size_t leaf_size, Compare comp,
+		tests::random_access_iterator_tag) {
+		if (static_cast<std::size_t>(last - first) > leaf_size)
 			return false;
-		return !(value < *it);
+		tests::sort_network(first, last, comp);
+		return true;
+	}
+
+	template<typename ForwardIt, typename Compare>
+	bool sort_leaf_impl(ForwardIt, ForwardIt, std::size_t, Compare,
+		tests::forward_iterator_tag) {
+		return false;
+	}
+
+	// sorts [first, last) and returns true if it is small enough for a network
+	template<typename ForwardIt, typename Compare>
+	bool sort_leaf(ForwardIt first, ForwardIt last, std::size_t leaf_size, Compare comp) {
+		if (leaf_size > sort_network_max)
+			leaf_size = sort_network_max;
+		return tests::sort_leaf_impl(first, last, leaf_size, comp,
+			typename tests::iterator_traits<ForwardIt>::iterator_category{});
 	}
 }
 
@@ -158,44 +864,679 @@ namespace tests {
 		return it_first;
 	}
 
-	template<typename InputIt, typename OutputIt>
-	OutputIt merge(InputIt first1, InputIt last1, InputIt first2, InputIt last2,
-		OutputIt out_it) {
-		for (; first1 != last1 && first2 != last2; ++out_it) {
-			if (*first1 < *first2) {
-				*out_it = *first1;
-				++first1;
-			}
-			else {
-				*out_it = *first2;
-				++first2;
+	// forward partition reading block by block; only the write position
+	// steps through the container
+	template<typename SegIt, typename UnaryPredicate>
+	SegIt partition_impl(SegIt begin, SegIt end, UnaryPredicate pred, std::true_type) {
+		SegIt first = begin;
+		tests::for_each_segment(begin, end, [&first, &pred](auto it, auto last) {
+			for (; it != last; ++it) {
+				if (pred(*it)) {
+					if (std::addressof(*first) != std::addressof(*it))
+						std::iter_swap(it, first);
+					++first;
+				}
 			}
-		}
-
-		out_it = std::copy(first1, last1, out_it);
-		out_it = std::copy(first2, last2, out_it);
+		});
+		return first;
+	}
 
-		return out_it;
+	template<typename ForwardIt, typename UnaryPredicate>
+	ForwardIt partition_impl(ForwardIt begin, ForwardIt end, UnaryPredicate pred,
+		std::false_type) {
+		return tests::partition_impl(begin, end, pred,
+			typename tests::iterator_traits<ForwardIt>::iterator_category{});
+	}
+
+	template<typename RanIt1, typename RanIt2, typename OutputIt, typename Compare>
+	OutputIt merge_gallop_loop(RanIt1& first1, RanIt1 last1, RanIt2& first2, RanIt2 last2,
+		OutputIt out, Compare comp);
+
+	// like std::merge, ties go to the first range
+	template<typename InputIt, typename OutputIt, typename Compare>
+	OutputIt merge_impl(InputIt& first1, InputIt last1, InputIt& first2, InputIt last2,
+		OutputIt out_it, Compare comp, tests::input_iterator_tag) {
+		for (; first1 != last1 && first2 != last2; ++out_it) {
+			if (comp(*first2, *first1)) {
+				*out_it = *first2;
+				++first2;
+			}
+			else {
+				*out_it = *first1;
+				++first1;
+			}
+		}
+		return out_it;
+	}
+
+	// long streaks from one side are found by galloping and copied as a
+	// block, so merging m elements into n costs O(m log(n / m)) comparisons
+	template<typename RanIt, typename OutputIt, typename Compare>
+	OutputIt merge_impl(RanIt& first1, RanIt last1, RanIt& first2, RanIt last2,
+		OutputIt out_it, Compare comp, tests::random_access_iterator_tag) {
+		return tests::merge_gallop_loop(first1, last1, first2, last2, out_it, comp);
+	}
+
+	template<typename InputIt, typename OutputIt, typename Compare>
+	OutputIt merge(InputIt first1, InputIt last1, InputIt first2, InputIt last2,
+		OutputIt out_it, Compare comp) {
+		out_it = tests::merge_impl(first1, last1, first2, last2, out_it, comp,
+			typename tests::iterator_traits<InputIt>::iterator_category{});
+
+		out_it = std::copy(first1, last1, out_it);
+		out_it = std::copy(first2, last2, out_it);
+
+		return out_it;
+	}
+
+	template<typename InputIt, typename OutputIt>
+	OutputIt merge(InputIt first1, InputIt last1, InputIt first2, InputIt last2,
+		OutputIt out_it) {
+		return tests::merge(first1, last1, first2, last2, out_it,
+			tests::less<typename tests::iterator_traits<InputIt>::value_type>{});
+	}
+
+	template<typename ForwardIt, typename diff_type, typename T, typename Compare>
+	void merge_sort_impl(ForwardIt first, ForwardIt last, diff_type n, std::size_t leaf_size,
+		tests::uninitialized_buffer<T>& temp, Compare comp);
+
+	// temp must hold n = distance(first, last) elements; every level of the
+	// recursion reuses it, since a node only merges after its children finish
+	template<typename ForwardIt, typename diff_type, typename T, typename Compare>
+	void merge_sort_impl(ForwardIt first, ForwardIt last, diff_type n, std::size_t leaf_size,
+		tests::uninitialized_buffer<T>& temp, Compare comp, std::false_type) {
+		if (n <= 1 || tests::sort_leaf(first, last, leaf_size, comp))
+			return;
+
+		auto mid = tests::next(first, n / 2);
+
+		tests::merge_sort_impl(first, mid, n / 2, leaf_size, temp, comp);
+		tests::merge_sort_impl(mid, last, n - n / 2, leaf_size, temp, comp);
+
+		// both halves are dead once merged, so move through the buffer and back
+		tests::merge(std::make_move_iterator(first), std::make_move_iterator(mid),
+			std::make_move_iterator(mid), std::make_move_iterator(last),
+			std::back_inserter(temp), comp);
+
+		std::move(temp.begin(), temp.end(), first);
+		temp.clear();
+	}
+
+	// a subrange inside one block is sorted through raw pointers
+	template<typename SegIt, typename diff_type, typename T, typename Compare>
+	void merge_sort_impl(SegIt first, SegIt last, diff_type n, std::size_t leaf_size,
+		tests::uninitialized_buffer<T>& temp, Compare comp, std::true_type) {
+		using traits = tests::segmented_iterator_traits<SegIt>;
+		auto local = traits::local(first);
+		if (traits::end(traits::segment(first)) - local >= n)
+			tests::merge_sort_impl(local, local + n, n, leaf_size, temp, comp);
+		else
+			tests::merge_sort_impl(first, last, n, leaf_size, temp, comp, std::false_type{});
+	}
+
+	template<typename ForwardIt, typename diff_type, typename T, typename Compare>
+	void merge_sort_impl(ForwardIt first, ForwardIt last, diff_type n, std::size_t leaf_size,
+		tests::uninitialized_buffer<T>& temp, Compare comp) {
+		tests::merge_sort_impl(first, last, n, leaf_size, temp, comp,
+			tests::is_segmented_iterator<ForwardIt>{});
+	}
+
+	template<typename ForwardIt, typename T>
+	void merge_sort_impl(ForwardIt first, ForwardIt last, std::size_t leaf_size,
+		tests::uninitialized_buffer<T>& temp) {
+		tests::merge_sort_impl(first, last, tests::distance(first, last), leaf_size, temp,
+			tests::less<T>{});
+	}
+
+	// Not stable on random access ranges: their leaves are sorted by a network.
+	// scratch must have room for distance(first, last) elements.
+	template<typename ForwardIt, typename T, typename Compare>
+	void merge_sort(ForwardIt first, ForwardIt last, T* scratch, std::size_t capacity,
+		Compare comp) {
+		static_assert(std::is_same<T, typename tests::iterator_traits<ForwardIt>::value_type>::value,
+			"merge_sort scratch must hold the element type");
+		auto n = tests::distance(first, last);
+		assert(capacity >= static_cast<std::size_t>(n));
+		tests::uninitialized_buffer<T> temp(scratch, capacity);
+		tests::merge_sort_impl(first, last, n, small_sort_threshold, temp, comp);
+	}
+
+	template<typename ForwardIt, typename T>
+	void merge_sort(ForwardIt first, ForwardIt last, T* scratch, std::size_t capacity) {
+		tests::merge_sort(first, last, scratch, capacity, tests::less<T>{});
+	}
+
+	template<typename ForwardIt, typename Compare>
+	void merge_sort(ForwardIt first, ForwardIt last, tests::scratch_arena& arena,
+		Compare comp) {
+		using value_type = typename tests::iterator_traits<ForwardIt>::value_type;
+		auto n = static_cast<std::size_t>(tests::distance(first, last));
+		tests::merge_sort(first, last, arena.get<value_type>(n), n, comp);
+	}
+
+	template<typename ForwardIt>
+	void merge_sort(ForwardIt first, ForwardIt last, tests::scratch_arena& arena) {
+		tests::merge_sort(first, last, arena,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
+	}
+
+	template<typename ForwardIt, typename Compare>
+	void merge_sort(ForwardIt first, ForwardIt last, Compare comp) {
+		tests::scratch_arena arena;
+		tests::merge_sort(first, last, arena, comp);
 	}
 
 	template<typename ForwardIt>
 	void merge_sort(ForwardIt first, ForwardIt last) {
-		auto dist = tests::distance(first, last);
-		if (dist <= 1)
+		tests::scratch_arena arena;
+		tests::merge_sort(first, last, arena);
+	}
+
+	// sorts by comp on proj(element), e.g. proj = &item::key
+	template<typename ForwardIt, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt> merge_sort(ForwardIt first, ForwardIt last,
+		Compare comp, Projection proj) {
+		tests::merge_sort(first, last, tests::make_projected_compare(comp, proj));
+	}
+}
+
+// adaptive merge sort
+namespace tests {
+	// consecutive wins from one side before a merge switches to galloping
+	constexpr std::size_t gallop_threshold = 7;
+
+	// first position in [first, last) not less than key, probing 1, 3, 7, ...
+	// so the cost grows with the distance found, not the range length
+	template<typename RanIt, typename T, typename Compare>
+	RanIt gallop_lower_bound(RanIt first, RanIt last, const T& key, Compare comp) {
+		auto n = last - first;
+		if (n == 0 || !comp(first[0], key))
+			return first;
+
+		decltype(n) prev = 0, cur = 1;
+		while (cur < n && comp(first[cur], key)) {
+			prev = cur;
+			cur = 2 * cur + 1;
+		}
+		if (cur > n)
+			cur = n;
+		return tests::lower_bound(first + (prev + 1), first + cur, key, comp);
+	}
+
+	// first position in [first, last) greater than key, galloping as above
+	template<typename RanIt, typename T, typename Compare>
+	RanIt gallop_upper_bound(RanIt first, RanIt last, const T& key, Compare comp) {
+		auto n = last - first;
+		if (n == 0 || comp(key, first[0]))
+			return first;
+
+		decltype(n) prev = 0, cur = 1;
+		while (cur < n && !comp(key, first[cur])) {
+			prev = cur;
+			cur = 2 * cur + 1;
+		}
+		if (cur > n)
+			cur = n;
+		return tests::upper_bound(first + (prev + 1), first + cur, key, comp);
+	}
+
+	// Stable merge until either side runs out, advancing first1 and first2.
+	// After gallop_threshold consecutive wins from one side, the rest of that
+	// side's winning streak is found by galloping and copied as one block.
+	template<typename RanIt1, typename RanIt2, typename OutputIt, typename Compare>
+	OutputIt merge_gallop_loop(RanIt1& first1, RanIt1 last1, RanIt2& first2, RanIt2 last2,
+		OutputIt out, Compare comp) {
+		std::size_t wins1 = 0, wins2 = 0;
+		while (first1 != last1 && first2 != last2) {
+			if (comp(*first2, *first1)) {
+				*out = *first2;
+				++out;
+				++first2;
+				wins1 = 0;
+				if (++wins2 >= gallop_threshold && first2 != last2) {
+					auto block_last = tests::gallop_lower_bound(first2, last2, *first1, comp);
+					auto block = static_cast<std::size_t>(block_last - first2);
+					out = std::copy(first2, block_last, out);
+					first2 = block_last;
+					// a long block suggests the streak goes on, so keep galloping
+					wins2 = block >= gallop_threshold ? gallop_threshold - 1 : 0;
+				}
+			}
+			else {
+				*out = *first1;
+				++out;
+				++first1;
+				wins2 = 0;
+				if (++wins1 >= gallop_threshold && first1 != last1) {
+					auto block_last = tests::gallop_upper_bound(first1, last1, *first2, comp);
+					auto block = static_cast<std::size_t>(block_last - first1);
+					out = std::copy(first1, block_last, out);
+					first1 = block_last;
+					wins1 = block >= gallop_threshold ? gallop_threshold - 1 : 0;
+				}
+			}
+		}
+		return out;
+	}
+
+	template<typename RanIt, typename Compare>
+	void binary_insertion_sort(RanIt first, RanIt sorted_last, RanIt last, Compare comp) {
+		for (; sorted_last != last; ++sorted_last) {
+			// upper_bound keeps equal elements in their original order
+			auto pos = tests::upper_bound(first, sorted_last, *sorted_last, comp);
+			auto value = std::move(*sorted_last);
+			std::move_backward(pos, sorted_last, sorted_last + 1);
+			*pos = std::move(value);
+		}
+	}
+
+	// end of the natural run starting at first; a strictly descending run is
+	// reversed in place, which cannot reorder equal elements
+	template<typename RanIt, typename Compare>
+	RanIt count_run(RanIt first, RanIt last, Compare comp) {
+		auto run_last = first + 1;
+		if (run_last == last)
+			return last;
+
+		if (comp(*run_last, *first)) {
+			while (++run_last != last && comp(*run_last, *(run_last - 1)));
+			std::reverse(first, run_last);
+		}
+		else {
+			while (++run_last != last && !comp(*run_last, *(run_last - 1)));
+		}
+		return run_last;
+	}
+
+	// n itself below 64; otherwise in [32, 64], chosen so n / min_run is a
+	// power of two or just below
+	template<typename diff_type>
+	diff_type min_run_length(diff_type n) {
+		diff_type r = 0;
+		while (n >= 64) {
+			r |= n & 1;
+			n >>= 1;
+		}
+		return n + r;
+	}
+
+	// Natural merge sort: splits the input into its existing runs, extends
+	// short ones to min_run with binary insertion, and merges them from a
+	// stack kept balanced so run lengths grow at least like Fibonacci numbers.
+	// scratch() must return room for (last - first) / 2 elements; it is only
+	// called once a merge needs it.
+	template<typename RanIt, typename Compare, typename Scratch>
+	class adaptive_sorter {
+	public:
+		using value_type = typename tests::iterator_traits<RanIt>::value_type;
+		using difference_type = typename tests::iterator_traits<RanIt>::difference_type;
+
+		adaptive_sorter(RanIt _first, RanIt _last, Compare _comp, Scratch _scratch) :
+			first(_first),
+			last(_last),
+			comp(_comp),
+			scratch(_scratch),
+			storage(nullptr) {
+		}
+
+		void sort() {
+			auto n = last - first;
+			if (n < 2)
+				return;
+
+			auto min_run = tests::min_run_length(n);
+			for (auto run_first = first; run_first != last; ) {
+				auto run_last = tests::count_run(run_first, last, comp);
+				if (run_last - run_first < min_run) {
+					auto forced_last = last - run_first <= min_run ? last : run_first + min_run;
+					tests::binary_insertion_sort(run_first, run_last, forced_last, comp);
+					run_last = forced_last;
+				}
+
+				runs.emplace_back(run_first - first, run_last - run_first);
+				collapse();
+				run_first = run_last;
+			}
+
+			while (runs.size() > 1) {
+				auto k = runs.size() - 2;
+				if (k > 0 && runs[k - 1].second < runs[k + 1].second)
+					--k;
+				merge_at(k);
+			}
+		}
+
+	private:
+		// restores len[k - 2] > len[k - 1] + len[k] and len[k - 1] > len[k]
+		// over the top four runs, the corrected TimSort invariant
+		void collapse() {
+			while (runs.size() > 1) {
+				auto k = runs.size() - 2;
+				if ((k > 0 && runs[k - 1].second <= runs[k].second + runs[k + 1].second)
+					|| (k > 1 && runs[k - 2].second <= runs[k - 1].second + runs[k].second)) {
+					if (runs[k - 1].second < runs[k + 1].second)
+						--k;
+				}
+				else if (runs[k].second > runs[k + 1].second) {
+					break;
+				}
+				merge_at(k);
+			}
+		}
+
+		void merge_at(std::size_t k) {
+			RanIt a = first + runs[k].first;
+			RanIt b = first + runs[k + 1].first;
+			RanIt e = b + runs[k + 1].second;
+			runs[k].second += runs[k + 1].second;
+			runs.erase(runs.begin() + (k + 1));
+
+			// the prefix of run 1 not greater than run 2's head and the suffix
+			// of run 2 not less than run 1's tail are already in place
+			a = tests::gallop_upper_bound(a, b, *b, comp);
+			if (a == b)
+				return;
+			e = tests::gallop_lower_bound(b, e, *(b - 1), comp);
+
+			if (e - b < b - a)
+				merge_hi(a, b, e);
+			else
+				merge_lo(a, b, e);
+		}
+
+		// fetched by the first merge, so presorted input never allocates
+		value_type* scratch_storage() {
+			if (!storage)
+				storage = scratch();
+			return storage;
+		}
+
+		// run 1 goes to the buffer and the merge fills [a, e) front to back
+		void merge_lo(RanIt a, RanIt b, RanIt e) {
+			tests::uninitialized_buffer<value_type> buffer(scratch_storage(),
+				static_cast<std::size_t>((last - first) / 2));
+			for (auto it = a; it != b; ++it)
+				buffer.push_back(std::move(*it));
+
+			auto first1 = std::make_move_iterator(buffer.begin());
+			auto last1 = std::make_move_iterator(buffer.end());
+			auto first2 = std::make_move_iterator(b);
+			auto out = tests::merge_gallop_loop(first1, last1, first2,
+				std::make_move_iterator(e), a, comp);
+
+			// whatever is left of run 2 is already in place
+			std::copy(first1, last1, out);
+			buffer.clear();
+		}
+
+		// run 2 goes to the buffer and the merge fills [a, e) back to front;
+		// on ties the reversed merge takes the buffer first, keeping stability
+		void merge_hi(RanIt a, RanIt b, RanIt e) {
+			tests::uninitialized_buffer<value_type> buffer(scratch_storage(),
+				static_cast<std::size_t>((last - first) / 2));
+			for (auto it = b; it != e; ++it)
+				buffer.push_back(std::move(*it));
+
+			using buffer_rit = std::reverse_iterator<value_type*>;
+			using range_rit = std::reverse_iterator<RanIt>;
+			auto first1 = std::make_move_iterator(buffer_rit(buffer.end()));
+			auto last1 = std::make_move_iterator(buffer_rit(buffer.begin()));
+			auto first2 = std::make_move_iterator(range_rit(b));
+			auto comp_reversed = [this](const value_type& x, const value_type& y) {
+				return comp(y, x);
+			};
+			auto out = tests::merge_gallop_loop(first1, last1, first2,
+				std::make_move_iterator(range_rit(a)), range_rit(e), comp_reversed);
+
+			std::copy(first1, last1, out);
+			buffer.clear();
+		}
+
+		RanIt first;
+		RanIt last;
+		Compare comp;
+		Scratch scratch;
+		value_type* storage;
+		std::vector<tests::pair<difference_type, difference_type>> runs;
+	};
+
+	template<typename RanIt, typename Compare, typename Scratch>
+	void adaptive_sort_impl(RanIt first, RanIt last, Compare comp, Scratch scratch,
+		tests::random_access_iterator_tag) {
+		tests::adaptive_sorter<RanIt, Compare, Scratch>(first, last, comp, scratch).sort();
+	}
+
+	// runs need random access, so other ranges are sorted through a vector
+	template<typename ForwardIt, typename Compare, typename Scratch>
+	void adaptive_sort_impl(ForwardIt first, ForwardIt last, Compare comp, Scratch scratch,
+		tests::forward_iterator_tag) {
+		std::vector<typename tests::iterator_traits<ForwardIt>::value_type> temp(
+			std::make_move_iterator(first), std::make_move_iterator(last));
+		tests::adaptive_sort_impl(temp.begin(), temp.end(), comp, scratch,
+			tests::random_access_iterator_tag{});
+		std::move(temp.begin(), temp.end(), first);
+	}
+
+	// scratch must have room for distance(first, last) / 2 elements
+	template<typename ForwardIt, typename T, typename Compare>
+	void adaptive_sort(ForwardIt first, ForwardIt last, T* scratch, std::size_t capacity,
+		Compare comp) {
+		static_assert(std::is_same<T, typename tests::iterator_traits<ForwardIt>::value_type>::value,
+			"adaptive_sort scratch must hold the element type");
+		assert(capacity >= static_cast<std::size_t>(tests::distance(first, last) / 2));
+		tests::adaptive_sort_impl(first, last, comp, [scratch]() { return scratch; },
+			typename tests::iterator_traits<ForwardIt>::iterator_category{});
+	}
+
+	template<typename ForwardIt, typename T>
+	void adaptive_sort(ForwardIt first, ForwardIt last, T* scratch, std::size_t capacity) {
+		tests::adaptive_sort(first, last, scratch, capacity, tests::less<T>{});
+	}
+
+	template<typename ForwardIt, typename Compare>
+	void adaptive_sort(ForwardIt first, ForwardIt last, tests::scratch_arena& arena,
+		Compare comp) {
+		using value_type = typename tests::iterator_traits<ForwardIt>::value_type;
+		auto half = static_cast<std::size_t>(tests::distance(first, last) / 2);
+		tests::adaptive_sort_impl(first, last, comp,
+			[&arena, half]() { return arena.get<value_type>(half); },
+			typename tests::iterator_traits<ForwardIt>::iterator_category{});
+	}
+
+	template<typename ForwardIt>
+	void adaptive_sort(ForwardIt first, ForwardIt last, tests::scratch_arena& arena) {
+		tests::adaptive_sort(first, last, arena,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
+	}
+
+	// stable; O(n) on sorted or reversed input and O(n + k log k) for a sorted
+	// range followed by k unsorted elements
+	template<typename ForwardIt, typename Compare>
+	void adaptive_sort(ForwardIt first, ForwardIt last, Compare comp) {
+		tests::scratch_arena arena;
+		tests::adaptive_sort(first, last, arena, comp);
+	}
+
+	template<typename ForwardIt>
+	void adaptive_sort(ForwardIt first, ForwardIt last) {
+		tests::adaptive_sort(first, last,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
+	}
+
+	// sorts by comp on proj(element), e.g. proj = &item::key
+	template<typename ForwardIt, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt> adaptive_sort(ForwardIt first,
+		ForwardIt last, Compare comp, Projection proj) {
+		tests::adaptive_sort(first, last, tests::make_projected_compare(comp, proj));
+	}
+}
+
+// algorithms // in-place merge
+namespace tests {
+	// run 1 goes to temp and the merge fills [first, last) front to back;
+	// temp must have room for run 1
+	template<typename ForwardIt, typename T, typename Compare>
+	void merge_buffered(ForwardIt first, ForwardIt mid, ForwardIt last,
+		tests::uninitialized_buffer<T>& temp, Compare comp) {
+		for (auto it = first; it != mid; ++it)
+			temp.push_back(std::move(*it));
+
+		auto it1 = temp.begin();
+		for (; it1 != temp.end() && mid != last; ++first) {
+			// ties go to run 1, so the merge is stable
+			if (comp(*mid, *it1)) {
+				*first = std::move(*mid);
+				++mid;
+			}
+			else {
+				*first = std::move(*it1);
+				++it1;
+			}
+		}
+
+		// whatever is left of run 2 is already in place
+		std::move(it1, temp.end(), first);
+		temp.clear();
+	}
+
+	// Merges the sorted runs [first, mid) and [mid, last) of n1 and n2
+	// elements. A run 1 that fits temp merges through it. Longer runs are
+	// split by rotation (Dudzinski and Dydek): the longer run is halved, the
+	// other cut at the matching bound, and rotating the two middle pieces
+	// past each other leaves two independent smaller merges. Without any
+	// buffer that costs O(n log n) moves and O(log n) stack.
+	template<typename ForwardIt, typename diff_type, typename T, typename Compare>
+	void inplace_merge_impl(ForwardIt first, ForwardIt mid, ForwardIt last,
+		diff_type n1, diff_type n2, tests::uninitialized_buffer<T>& temp, Compare comp) {
+		if (n1 == 0 || n2 == 0)
+			return;
+		if (n1 + n2 == 2) {
+			if (comp(*mid, *first))
+				std::iter_swap(first, mid);
+			return;
+		}
+		if (static_cast<std::size_t>(n1) <= temp.capacity()) {
+			tests::merge_buffered(first, mid, last, temp, comp);
 			return;
+		}
 
-		auto mid = tests::next(first, dist / 2);
+		ForwardIt cut1, cut2;
+		diff_type n11, n22;
+		if (n1 > n2) {
+			n11 = n1 / 2;
+			cut1 = tests::next(first, n11);
+			cut2 = tests::lower_bound(mid, last, *cut1, comp);
+			n22 = tests::distance(mid, cut2);
+		}
+		else {
+			n22 = n2 / 2;
+			cut2 = tests::next(mid, n22);
+			cut1 = tests::upper_bound(first, mid, *cut2, comp);
+			n11 = tests::distance(first, cut1);
+		}
 
-		merge_sort(first, mid);
-		merge_sort(mid, last);
+		auto new_mid = std::rotate(cut1, mid, cut2);
+		tests::inplace_merge_impl(first, cut1, new_mid, n11, n22, temp, comp);
+		tests::inplace_merge_impl(new_mid, cut2, last, n1 - n11, n2 - n22, temp, comp);
+	}
 
-		std::vector<tests::iterator_traits<ForwardIt>::value_type> temp;
+	// scratch may have room for fewer elements than run 1, down to none
+	template<typename ForwardIt, typename T, typename Compare>
+	void inplace_merge(ForwardIt first, ForwardIt mid, ForwardIt last, T* scratch,
+		std::size_t capacity, Compare comp) {
+		static_assert(std::is_same<T, typename tests::iterator_traits<ForwardIt>::value_type>::value,
+			"inplace_merge scratch must hold the element type");
+		tests::uninitialized_buffer<T> temp(scratch, capacity);
+		tests::inplace_merge_impl(first, mid, last, tests::distance(first, mid),
+			tests::distance(mid, last), temp, comp);
+	}
+
+	template<typename ForwardIt, typename T>
+	void inplace_merge(ForwardIt first, ForwardIt mid, ForwardIt last, T* scratch,
+		std::size_t capacity) {
+		tests::inplace_merge(first, mid, last, scratch, capacity, tests::less<T>{});
+	}
 
-		temp.resize(dist);
+	// stable; merges through a buffer for run 1 if one can be allocated and
+	// without extra memory otherwise
+	template<typename ForwardIt, typename Compare>
+	void inplace_merge(ForwardIt first, ForwardIt mid, ForwardIt last, Compare comp) {
+		using value_type = typename tests::iterator_traits<ForwardIt>::value_type;
+		auto n1 = tests::distance(first, mid);
+		tests::uninitialized_buffer<value_type> temp(static_cast<std::size_t>(n1), std::nothrow);
+		tests::inplace_merge_impl(first, mid, last, n1, tests::distance(mid, last), temp, comp);
+	}
 
-		tests::merge(first, mid, mid, last, temp.begin());
+	template<typename ForwardIt>
+	void inplace_merge(ForwardIt first, ForwardIt mid, ForwardIt last) {
+		tests::inplace_merge(first, mid, last,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
+	}
+
+	// unlike sort_leaf, keeps equal elements in order
+	template<typename RanIt, typename Compare>
+	bool stable_sort_leaf(RanIt first, RanIt last, Compare comp,
+		tests::random_access_iterator_tag) {
+		if (static_cast<std::size_t>(last - first) > small_sort_threshold)
+			return false;
+		tests::binary_insertion_sort(first, first, last, comp);
+		return true;
+	}
 
-		std::copy(temp.begin(), temp.end(), first);
+	template<typename ForwardIt, typename Compare>
+	bool stable_sort_leaf(ForwardIt, ForwardIt, Compare, tests::forward_iterator_tag) {
+		return false;
+	}
+
+	template<typename ForwardIt, typename diff_type, typename T, typename Compare>
+	void inplace_merge_sort_impl(ForwardIt first, ForwardIt last, diff_type n,
+		tests::uninitialized_buffer<T>& temp, Compare comp) {
+		if (n <= 1 || tests::stable_sort_leaf(first, last, comp,
+			typename tests::iterator_traits<ForwardIt>::iterator_category{}))
+			return;
+
+		auto mid = tests::next(first, n / 2);
+		tests::inplace_merge_sort_impl(first, mid, n / 2, temp, comp);
+		tests::inplace_merge_sort_impl(mid, last, n - n / 2, temp, comp);
+		tests::inplace_merge_impl(first, mid, last, n / 2, n - n / 2, temp, comp);
+	}
+
+	// Stable merge sort for a hard memory cap: at most scratch_limit elements
+	// of scratch, which merges of a run 1 that fits go through. The rest
+	// merge by rotation, so the cost goes from O(n log n) moves with n / 2
+	// elements of scratch to O(n log^2 n) with none.
+	template<typename ForwardIt, typename Compare>
+	void inplace_merge_sort(ForwardIt first, ForwardIt last, std::size_t scratch_limit,
+		Compare comp) {
+		using value_type = typename tests::iterator_traits<ForwardIt>::value_type;
+		auto n = tests::distance(first, last);
+		// run 1 is never longer than n / 2
+		auto capacity = static_cast<std::size_t>(n / 2);
+		if (capacity > scratch_limit)
+			capacity = scratch_limit;
+		tests::uninitialized_buffer<value_type> temp(capacity, std::nothrow);
+		tests::inplace_merge_sort_impl(first, last, n, temp, comp);
+	}
+
+	// scratch may have room for any number of elements, down to none
+	template<typename ForwardIt, typename T, typename Compare>
+	void inplace_merge_sort(ForwardIt first, ForwardIt last, T* scratch, std::size_t capacity,
+		Compare comp) {
+		static_assert(std::is_same<T, typename tests::iterator_traits<ForwardIt>::value_type>::value,
+			"inplace_merge_sort scratch must hold the element type");
+		tests::uninitialized_buffer<T> temp(scratch, capacity);
+		tests::inplace_merge_sort_impl(first, last, tests::distance(first, last), temp, comp);
+	}
+
+	template<typename ForwardIt, typename T>
+	void inplace_merge_sort(ForwardIt first, ForwardIt last, T* scratch, std::size_t capacity) {
+		tests::inplace_merge_sort(first, last, scratch, capacity, tests::less<T>{});
+	}
+
+	template<typename ForwardIt>
+	void inplace_merge_sort(ForwardIt first, ForwardIt last, std::size_t scratch_limit) {
+		tests::inplace_merge_sort(first, last, scratch_limit,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
 	}
 }
 
@@ -204,23 +1545,173 @@ namespace tests {
 	template<typename ForwardIt, typename UnaryPredicate>
 	ForwardIt partition(ForwardIt begin, ForwardIt end, UnaryPredicate pred) {
 		return tests::partition_impl(begin, end, pred,
-			tests::iterator_traits<ForwardIt>::iterator_category{});
+			tests::is_segmented_iterator<ForwardIt>{});
 	}
 
+	// bounds and sizes of the blocks a three-way partition leaves behind
 	template<typename ForwardIt>
-	void quick_sort(ForwardIt begin, ForwardIt end) {
-		if (begin == end)
+	struct three_way_partition {
+		ForwardIt equal_first;
+		ForwardIt equal_last;
+		typename tests::iterator_traits<ForwardIt>::difference_type less_count;
+		typename tests::iterator_traits<ForwardIt>::difference_type equal_count;
+	};
+
+	// One forward pass keeping [begin, lt) < pivot, [lt, eq) == pivot and
+	// [eq, it) > pivot. The equal block is never empty, so *lt always compares
+	// as the pivot and no copy of it is needed.
+	template<typename ForwardIt, typename Compare>
+	three_way_partition<ForwardIt> partition_pivot_impl(ForwardIt begin, ForwardIt end,
+		Compare comp, tests::forward_iterator_tag) {
+		auto lt = begin;
+		auto eq = tests::next(begin);
+		typename tests::iterator_traits<ForwardIt>::difference_type less_count = 0, equal_count = 1;
+		for (auto it = eq; it != end; ++it) {
+			if (comp(*it, *lt)) {
+				// greater block's head moves to the tail, equal block's head
+				// to its tail, and *it into the gap at lt
+				std::iter_swap(it, eq);
+				std::iter_swap(eq, lt);
+				++lt;
+				++eq;
+				++less_count;
+			}
+			else if (!comp(*lt, *it)) {
+				std::iter_swap(it, eq);
+				++eq;
+				++equal_count;
+			}
+		}
+		return{ lt, eq, less_count, equal_count };
+	}
+
+	// Dijkstra's Dutch national flag: greater elements are swapped to the
+	// back, so each costs one swap instead of two
+	template<typename BidIt, typename Compare>
+	three_way_partition<BidIt> partition_pivot_impl(BidIt begin, BidIt end,
+		Compare comp, tests::bidirectional_iterator_tag) {
+		auto lt = begin;
+		auto it = tests::next(begin);
+		auto gt = end;
+		typename tests::iterator_traits<BidIt>::difference_type less_count = 0, equal_count = 1;
+		while (it != gt) {
+			if (comp(*it, *lt)) {
+				std::iter_swap(lt, it);
+				++lt;
+				++it;
+				++less_count;
+			}
+			else if (comp(*lt, *it)) {
+				std::iter_swap(it, --gt);
+			}
+			else {
+				++it;
+				++equal_count;
+			}
+		}
+		return{ lt, gt, less_count, equal_count };
+	}
+
+	// Bentley-McIlroy: a Hoare partition that parks elements equal to the
+	// pivot at both ends as it meets them and swaps them to the middle at the
+	// end, so distinct keys cost no more swaps than a two-way partition
+	template<typename RanIt, typename Compare>
+	three_way_partition<RanIt> partition_pivot_impl(RanIt begin, RanIt end,
+		Compare comp, tests::random_access_iterator_tag) {
+		auto hi = end - begin - 1;
+		if (hi == 0)
+			return{ begin, end, 0, 1 };
+
+		// begin[0] holds the pivot until the final swaps
+		const auto& pivot = begin[0];
+		auto equal = [&pivot, &comp](const auto& x) {
+			return !comp(x, pivot) && !comp(pivot, x);
+		};
+
+		decltype(hi) i = 0, j = hi + 1, p = 0, q = hi + 1;
+		for (;;) {
+			while (comp(begin[++i], pivot))
+				if (i == hi)
+					break;
+			while (comp(pivot, begin[--j]))
+				if (j == 0)
+					break;
+
+			if (i == j && equal(begin[i]))
+				std::iter_swap(begin + ++p, begin + i);
+			if (i >= j)
+				break;
+
+			std::iter_swap(begin + i, begin + j);
+			if (equal(begin[i]))
+				std::iter_swap(begin + ++p, begin + i);
+			if (equal(begin[j]))
+				std::iter_swap(begin + --q, begin + j);
+		}
+
+		i = j + 1;
+		for (decltype(hi) k = 0; k <= p; ++k)
+			std::iter_swap(begin + k, begin + j--);
+		for (auto k = hi; k >= q; --k)
+			std::iter_swap(begin + k, begin + i++);
+
+		return{ begin + (j + 1), begin + i, j + 1, i - (j + 1) };
+	}
+
+	// splits the non-empty [begin, end) into elements less than, equal to and
+	// greater than *pivot_pos in a single pass
+	template<typename ForwardIt, typename Compare>
+	three_way_partition<ForwardIt> partition_pivot(ForwardIt begin, ForwardIt end,
+		ForwardIt pivot_pos, Compare comp) {
+		std::iter_swap(begin, pivot_pos);
+		return tests::partition_pivot_impl(begin, end, comp,
+			typename tests::iterator_traits<ForwardIt>::iterator_category{});
+	}
+
+	template<typename ForwardIt>
+	three_way_partition<ForwardIt> partition_pivot(ForwardIt begin, ForwardIt end,
+		ForwardIt pivot_pos) {
+		return tests::partition_pivot(begin, end, pivot_pos,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
+	}
+
+	// n is distance(begin, end), carried down so forward iterators only walk
+	// to the pivot, never to measure the range
+	template<typename ForwardIt, typename diff_type, typename Compare>
+	void quick_sort_impl(ForwardIt begin, ForwardIt end, diff_type n, std::size_t leaf_size,
+		Compare comp) {
+		if (n <= 1 || tests::sort_leaf(begin, end, leaf_size, comp))
 			return;
 
-		auto pivot = *tests::next(begin, tests::distance(begin, end) / 2);
-		auto middle1 = tests::partition(begin, end, [pivot](const auto& x) {
-			return x < pivot; });
-		auto middle2 = tests::partition(middle1, end, [pivot](const auto& x) {
-			return !(x > pivot);
-		});
+		auto parts = tests::partition_pivot(begin, end, tests::next(begin, n / 2), comp);
 
-		quick_sort(begin, middle1);
-		quick_sort(middle2, end);
+		quick_sort_impl(begin, parts.equal_first, parts.less_count, leaf_size, comp);
+		quick_sort_impl(parts.equal_last, end, n - parts.less_count - parts.equal_count,
+			leaf_size, comp);
+	}
+
+	template<typename ForwardIt>
+	void quick_sort_impl(ForwardIt begin, ForwardIt end, std::size_t leaf_size) {
+		tests::quick_sort_impl(begin, end, tests::distance(begin, end), leaf_size,
+			tests::less<typename tests::iterator_traits<ForwardIt>::value_type>{});
+	}
+
+	template<typename ForwardIt, typename Compare>
+	void quick_sort(ForwardIt begin, ForwardIt end, Compare comp) {
+		tests::quick_sort_impl(begin, end, tests::distance(begin, end), small_sort_threshold,
+			comp);
+	}
+
+	template<typename ForwardIt>
+	void quick_sort(ForwardIt begin, ForwardIt end) {
+		tests::quick_sort_impl(begin, end, small_sort_threshold);
+	}
+
+	// sorts by comp on proj(element), e.g. proj = &item::key
+	template<typename ForwardIt, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt> quick_sort(ForwardIt begin, ForwardIt end,
+		Compare comp, Projection proj) {
+		tests::quick_sort(begin, end, tests::make_projected_compare(comp, proj));
 	}
 
 	template<typename ForwardIt, typename UnaryPred>
@@ -239,3 +1730,293 @@ namespace tests {
 
 	}
 }
+
+// algorithms // selection
+namespace tests {
+	template<typename ForwardIt>
+	void nth_element_impl(ForwardIt first, ForwardIt last, std::size_t n,
+		std::size_t depth_limit);
+
+	// moves the median of every group of five to the front and selects the
+	// median of those, a pivot that guarantees a constant fraction is discarded
+	template<typename ForwardIt>
+	ForwardIt median_of_medians(ForwardIt first, ForwardIt last) {
+		auto medians_last = first;
+		std::size_t groups = 0;
+		for (auto group = first; group != last; ++groups) {
+			auto group_last = group;
+			std::size_t size = 0;
+			for (; size < 5 && group_last != last; ++size, ++group_last);
+
+			tests::quick_sort(group, group_last);
+			std::iter_swap(medians_last, tests::next(group, size / 2));
+			++medians_last;
+			group = group_last;
+		}
+
+		tests::nth_element_impl(first, medians_last, groups / 2, 0);
+		return tests::next(first, groups / 2);
+	}
+
+	// introselect: quickselect with middle pivots for depth_limit levels, then
+	// median_of_medians pivots, which bound the whole selection to O(n)
+	template<typename ForwardIt>
+	void nth_element_impl(ForwardIt first, ForwardIt last, std::size_t n,
+		std::size_t depth_limit) {
+		auto dist = static_cast<std::size_t>(tests::distance(first, last));
+		while (dist > small_sort_threshold) {
+			ForwardIt pivot_pos;
+			if (depth_limit == 0) {
+				pivot_pos = tests::median_of_medians(first, last);
+			}
+			else {
+				--depth_limit;
+				pivot_pos = tests::next(first, dist / 2);
+			}
+
+			auto parts = tests::partition_pivot(first, last, pivot_pos);
+			auto less_count = static_cast<std::size_t>(parts.less_count);
+			auto not_greater_count = less_count + static_cast<std::size_t>(parts.equal_count);
+
+			if (n < less_count) {
+				last = parts.equal_first;
+				dist = less_count;
+			}
+			else if (n < not_greater_count) {
+				return;
+			}
+			else {
+				first = parts.equal_last;
+				n -= not_greater_count;
+				dist -= not_greater_count;
+			}
+		}
+
+		tests::quick_sort(first, last);
+	}
+
+	template<typename ForwardIt>
+	void nth_element(ForwardIt first, ForwardIt nth, ForwardIt last) {
+		if (nth == last)
+			return;
+
+		auto dist = static_cast<std::size_t>(tests::distance(first, last));
+		std::size_t depth_limit = 0;
+		for (; dist > 1; dist >>= 1)
+			depth_limit += 2;
+
+		tests::nth_element_impl(first, last,
+			static_cast<std::size_t>(tests::distance(first, nth)), depth_limit);
+	}
+
+	template<typename ForwardIt>
+	void partial_sort(ForwardIt first, ForwardIt middle, ForwardIt last) {
+		tests::nth_element(first, middle, last);
+		tests::quick_sort(first, middle);
+	}
+
+	// max-heap (under comp) helpers over [first, first + len)
+	template<typename RanIt, typename Compare>
+	void heap_sift_down(RanIt first, std::size_t len, std::size_t hole, Compare comp) {
+		auto value = std::move(first[hole]);
+		for (;;) {
+			auto child = 2 * hole + 1;
+			if (child >= len)
+				break;
+			if (child + 1 < len && comp(first[child], first[child + 1]))
+				++child;
+			if (!comp(value, first[child]))
+				break;
+			first[hole] = std::move(first[child]);
+			hole = child;
+		}
+		first[hole] = std::move(value);
+	}
+
+	template<typename RanIt, typename Compare>
+	void heap_sift_up(RanIt first, std::size_t hole, Compare comp) {
+		auto value = std::move(first[hole]);
+		while (hole > 0) {
+			auto parent = (hole - 1) / 2;
+			if (!comp(first[parent], value))
+				break;
+			first[hole] = std::move(first[parent]);
+			hole = parent;
+		}
+		first[hole] = std::move(value);
+	}
+
+	template<typename RanIt, typename Compare>
+	void make_heap(RanIt first, std::size_t len, Compare comp) {
+		for (auto i = len / 2; i > 0; --i)
+			tests::heap_sift_down(first, len, i - 1, comp);
+	}
+
+	template<typename RanIt, typename Compare>
+	void sort_heap(RanIt first, std::size_t len, Compare comp) {
+		for (; len > 1; --len) {
+			std::iter_swap(first, first + (len - 1));
+			tests::heap_sift_down(first, len - 1, 0, comp);
+		}
+	}
+
+	template<typename InputIt, typename RanIt>
+	RanIt partial_sort_copy(InputIt first, InputIt last, RanIt d_first, RanIt d_last) {
+		tests::less<typename tests::iterator_traits<RanIt>::value_type> comp;
+		auto k = static_cast<std::size_t>(d_last - d_first);
+		std::size_t len = 0;
+		for (; first != last && len < k; ++first, ++len)
+			d_first[len] = *first;
+
+		tests::make_heap(d_first, len, comp);
+		for (; len && first != last; ++first) {
+			if (comp(*first, d_first[0])) {
+				d_first[0] = *first;
+				tests::heap_sift_down(d_first, len, 0, comp);
+			}
+		}
+
+		tests::sort_heap(d_first, len, comp);
+		return d_first + len;
+	}
+
+	// streaming accumulator of the k first values under comp (the k smallest
+	// with tests::less, the k largest with std::greater) in a bounded heap;
+	// a value costs O(log k) only when it enters the top k
+	template<typename T, typename Compare = tests::less<T>>
+	class top_k {
+	public:
+		explicit top_k(std::size_t _k, Compare _comp = Compare{}) : k(_k), comp(_comp) {
+			heap.reserve(k);
+		}
+
+		void push(const T& x) {
+			if (heap.size() < k) {
+				heap.push_back(x);
+				tests::heap_sift_up(heap.begin(), heap.size() - 1, comp);
+			}
+			else if (k && comp(x, heap.front())) {
+				heap.front() = x;
+				tests::heap_sift_down(heap.begin(), heap.size(), 0, comp);
+			}
+		}
+
+		void push(T&& x) {
+			if (heap.size() < k) {
+				heap.push_back(std::move(x));
+				tests::heap_sift_up(heap.begin(), heap.size() - 1, comp);
+			}
+			else if (k && comp(x, heap.front())) {
+				heap.front() = std::move(x);
+				tests::heap_sift_down(heap.begin(), heap.size(), 0, comp);
+			}
+		}
+
+		template<typename InputIt>
+		void push(InputIt first, InputIt last) {
+			for (; first != last; ++first)
+				push(*first);
+		}
+
+		std::size_t size() const { return heap.size(); }
+
+		// in heap order
+		const std::vector<T>& values() const { return heap; }
+
+		std::vector<T> sorted() const {
+			auto res = heap;
+			tests::sort_heap(res.begin(), res.size(), comp);
+			return res;
+		}
+
+	private:
+		std::size_t k;
+		Compare comp;
+		std::vector<T> heap;
+	};
+}
+
+// algorithms // indirect sort
+namespace tests {
+	// Moves the element at order[j].second to position j for every j, with
+	// at(i) the element at position i. Each cycle of the permutation is
+	// followed once through a single temporary, so sorting costs n plus the
+	// number of cycles moves. order is left as the identity.
+	template<typename Key, typename Index, typename At>
+	void apply_order(std::vector<tests::pair<Key, Index>>& order, At at) {
+		for (Index j = 0; j < order.size(); ++j) {
+			if (order[j].second == j)
+				continue;
+
+			auto value = std::move(at(j));
+			Index k = j;
+			while (order[k].second != j) {
+				Index from = order[k].second;
+				at(k) = std::move(at(from));
+				order[k].second = k;
+				k = from;
+			}
+			at(k) = std::move(value);
+			order[k].second = k;
+		}
+	}
+
+	template<typename RanIt, typename Key, typename Index>
+	void apply_order_impl(RanIt first, std::vector<tests::pair<Key, Index>>& order,
+		tests::random_access_iterator_tag) {
+		tests::apply_order(order, [first](Index i) -> decltype(auto) { return first[i]; });
+	}
+
+	// other iterators can't jump to a position, so they are gathered first
+	template<typename ForwardIt, typename Key, typename Index>
+	void apply_order_impl(ForwardIt first, std::vector<tests::pair<Key, Index>>& order,
+		tests::forward_iterator_tag) {
+		std::vector<ForwardIt> positions;
+		positions.reserve(order.size());
+		for (std::size_t i = 0; i < order.size(); ++i, ++first)
+			positions.push_back(first);
+		tests::apply_order(order, [&positions](Index i) -> decltype(auto) {
+			return *positions[i];
+		});
+	}
+
+	template<typename Index, typename ForwardIt, typename Compare, typename Projection>
+	void indirect_sort_impl(ForwardIt first, std::size_t n, Compare comp, Projection proj) {
+		using key_type = std::decay_t<decltype(proj(*first))>;
+		std::vector<tests::pair<key_type, Index>> order;
+		order.reserve(n);
+		auto it = first;
+		for (Index i = 0; i < n; ++i, ++it)
+			order.emplace_back(proj(*it), i);
+
+		// ties broken by position, so the order is stable
+		tests::quick_sort(order.begin(), order.end(), [&comp](const auto& a, const auto& b) {
+			return comp(a.first, b.first) || (!comp(b.first, a.first) && a.second < b.second);
+		});
+
+		tests::apply_order_impl(first, order,
+			typename tests::iterator_traits<ForwardIt>::iterator_category{});
+	}
+
+	// Stable sort by comp on proj(element) for elements that are expensive to
+	// move: the keys are sorted as compact (key, index) pairs and every
+	// element is then moved into place once, plus one move per cycle.
+	template<typename ForwardIt, typename Compare, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt> indirect_sort(ForwardIt first,
+		ForwardIt last, Compare comp, Projection proj) {
+		auto n = static_cast<std::size_t>(tests::distance(first, last));
+		auto p = tests::make_projection(proj);
+		// 32-bit positions keep the pairs small wherever they can index the range
+		if (n <= std::numeric_limits<std::uint32_t>::max())
+			tests::indirect_sort_impl<std::uint32_t>(first, n, comp, p);
+		else
+			tests::indirect_sort_impl<std::size_t>(first, n, comp, p);
+	}
+
+	template<typename ForwardIt, typename Projection>
+	tests::enable_if_projection_t<Projection, ForwardIt> indirect_sort(ForwardIt first,
+		ForwardIt last, Projection proj) {
+		using key_type = std::decay_t<decltype(tests::make_projection(proj)(*first))>;
+		tests::indirect_sort(first, last, tests::less<key_type>{}, proj);
+	}
+}
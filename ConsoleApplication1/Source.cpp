@@ -1,19 +1,30 @@
 #include "Header.h"
+#include "tests_instrument.h"
+#include "tests_sorted_index.h"
+#include "tests_unrolled_list.h"
+#include "tests_dense_int_index.h"
+#include "tests_task.h"
+#include "tests_range.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
 #include <assert.h>
 #include <list>
 #include <forward_list>
+#include <deque>
 #include <random>
 #include <sstream>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <typeinfo>
+#include <mutex>
+#include <numeric>
+#include <string>
 #include <Windows.h>
-#include <future>
-#include <ppltasks.h>
-
-using namespace concurrency;
-
+#include <Psapi.h>
 #undef assert
 
 void assert(bool cond) {
@@ -40,20 +51,48 @@ struct measure_time {
 	}
 };
 
+// operation counts of the std:: and tests:: sides of a test, printed on exit
+struct measure_ops {
+	std::string func_name;
+	tests::instrument::counters std_ops;
+	tests::instrument::counters tests_ops;
+	explicit measure_ops(std::string&& _func_name) :
+		func_name(std::forward<std::string>(_func_name)) {
+	}
+	~measure_ops() {
+		std::ostringstream os;
+		os << func_name << ": std " << std_ops << "\n"
+			<< func_name << ": tests " << tests_ops << "\n";
+		std::cout << os.str();
+	}
+};
+
 template<typename C, typename T>
-void check(const C& c, const T& val_begin, const T& val_end) {
+void check(const C& c, const T& val_begin, const T& val_end, measure_ops& ops) {
+	using tests::instrument::record;
+
+	auto first = tests::instrument::make_counting_iterator(c.begin());
+	auto last = tests::instrument::make_counting_iterator(c.end());
+	tests::instrument::counting_compare<tests::less<T>> comp;
+
 	for (T x = val_begin; x < val_end; ++x) {
-		assert(std::lower_bound(c.begin(), c.end(), x)
-			== tests::lower_bound(c.begin(), c.end(), x));
+		assert(record(ops.std_ops, [&] { return std::lower_bound(first, last, x, comp); })
+			== record(ops.tests_ops, [&] { return tests::lower_bound(first, last, x, comp); }));
 
-		assert(std::upper_bound(c.begin(), c.end(), x)
-			== tests::upper_bound(c.begin(), c.end(), x));
+		assert(record(ops.std_ops, [&] { return std::upper_bound(first, last, x, comp); })
+			== record(ops.tests_ops, [&] { return tests::upper_bound(first, last, x, comp); }));
 
-		assert(std::equal_range(c.begin(), c.end(), x)
-			== tests::equal_range(c.begin(), c.end(), x));
+		assert(record(ops.std_ops, [&] { return std::equal_range(first, last, x, comp); })
+			== record(ops.tests_ops, [&] { return tests::equal_range(first, last, x, comp); }));
 
-		assert(std::binary_search(c.begin(), c.end(), x)
-			== tests::binary_search(c.begin(), c.end(), x));
+		assert(record(ops.std_ops, [&] { return std::binary_search(first, last, x, comp); })
+			== record(ops.tests_ops, [&] { return tests::binary_search(first, last, x, comp); }));
+
+		auto range = std::equal_range(c.begin(), c.end(), x);
+		auto query = tests::equal_range_query(c.begin(), c.end(), x);
+		assert(query.lower == range.first && query.upper == range.second);
+		assert(query.found == std::binary_search(c.begin(), c.end(), x));
+		assert(query.count == std::distance(range.first, range.second));
 	}
 
 	C test1(c);
@@ -104,6 +143,18 @@ struct add_impl<std::forward_list<T>, T> {
 	}
 };
 
+template<typename T, std::size_t N>
+struct add_impl<tests::unrolled_list<T, N>, T> {
+	static void add(tests::unrolled_list<T, N>& c, T&& item) {
+		c.push_back(std::forward<T>(item));
+	}
+	static void sort(tests::unrolled_list<T, N>& c, T&& item) {
+		std::vector<T> v(std::make_move_iterator(c.begin()), std::make_move_iterator(c.end()));
+		std::sort(v.begin(), v.end());
+		std::move(v.begin(), v.end(), c.begin());
+	}
+};
+
 template<typename C, typename T>
 void add(C& c, T&& item, bool sort_items = true) {
 	add_impl<C, T>::add(c, std::forward<T>(item));
@@ -113,32 +164,33 @@ void add(C& c, T&& item, bool sort_items = true) {
 
 template<typename C, typename T>
 void binary_search_tests() {
+	measure_ops ops(std::string("binary_search_tests<") + typeid(C).name() + ">");
 	C v;
 
-	check(v, T(-2), T(2));
+	check(v, T(-2), T(2), ops);
 
 	add(v, T(1));
 
-	check(v, T(-5), T(5));
+	check(v, T(-5), T(5), ops);
 
 	add(v, T(1));
 
-	check(v, T(-5), T(5));
+	check(v, T(-5), T(5), ops);
 
 	for (int i = 0; i < 10; ++i)
 		add(v, T(1));
 
-	check(v, T(-5), T(5));
+	check(v, T(-5), T(5), ops);
 
 	for (int i = 0; i < 10; ++i)
 		add(v, T(2));
 
-	check(v, T(-5), T(5));
+	check(v, T(-5), T(5), ops);
 
 	for (int i = 0; i < 100; ++i)
 		add(v, T(rand() % 200));
 
-	check(v, T(-5), T(300));
+	check(v, T(-5), T(300), ops);
 }
 
 struct test_type {
@@ -164,16 +216,31 @@ bool operator==(const test_type& a, const test_type& b) {
 	return a.d == b.d;
 }
 
+// sorts a copy of c the std:: way, recording only the sort itself
+template<typename C>
+void std_sort(const C& c, measure_ops& ops) {
+	using T = typename C::value_type;
+	C copy(c);
+	T unused(0);
+	tests::instrument::record(ops.std_ops, [&copy, &unused] {
+		add_impl<C, T>::sort(copy, std::move(unused)); });
+	assert(std::is_sorted(copy.begin(), copy.end()));
+}
+
 template<typename C>
 void sort_test(){
+	using T = typename C::value_type;
+	using tests::instrument::record;
 	measure_time a("sort_test");
+	measure_ops ops(std::string("sort_test<") + typeid(C).name() + ">");
 
 	{
 		C v;
 
 		for (int i = 0; i < 500; ++i) {
-			add(v, rand(), 0);
-			tests::quick_sort(v.begin(), v.end());
+			add(v, T(rand()), 0);
+			std_sort(v, ops);
+			record(ops.tests_ops, [&v] { tests::quick_sort(v.begin(), v.end()); });
 			assert(std::is_sorted(v.begin(), v.end()));
 		}
 	}
@@ -182,11 +249,395 @@ void sort_test(){
 		C v;
 
 		for (int i = 0; i < 500; ++i) {
-			add(v, rand(), 0);
-			tests::merge_sort(v.begin(), v.end());
+			add(v, T(rand()), 0);
+			std_sort(v, ops);
+			record(ops.tests_ops, [&v] { tests::merge_sort(v.begin(), v.end()); });
 			assert(std::is_sorted(v.begin(), v.end()));
 		}
 	}
+
+	{
+		C v;
+
+		for (int i = 0; i < 500; ++i) {
+			add(v, T(rand()), 0);
+			std_sort(v, ops);
+			record(ops.tests_ops, [&v] { tests::adaptive_sort(v.begin(), v.end()); });
+			assert(std::is_sorted(v.begin(), v.end()));
+		}
+	}
+}
+
+// adaptive_sort must match std::stable_sort on every input shape, and cost
+// n - 1 comparisons on sorted input
+void adaptive_sort_test() {
+	using item = std::pair<int, int>;
+	auto by_key = [](const item& a, const item& b) {
+		return a.first < b.first;
+	};
+
+	const int size = 5000;
+	std::vector<std::vector<item>> inputs(6);
+	for (int i = 0; i < size; ++i) {
+		inputs[0].emplace_back(rand(), i);
+		inputs[1].emplace_back(rand() % 10, i);
+		inputs[2].emplace_back(i / 3, i);
+		inputs[3].emplace_back((size - i) / 3, i);
+		inputs[4].emplace_back(i < size - 50 ? i : rand() % size, i);
+		inputs[5].emplace_back(i % 100 < 50 ? i : size - i, i);
+	}
+
+	for (auto& input : inputs) {
+		auto v1 = input;
+		auto v2 = input;
+		std::stable_sort(v1.begin(), v1.end(), by_key);
+		tests::adaptive_sort(v2.begin(), v2.end(), by_key);
+		assert(v1 == v2);
+	}
+
+	std::list<item> l(inputs[1].begin(), inputs[1].end());
+	auto v = inputs[1];
+	std::stable_sort(v.begin(), v.end(), by_key);
+	tests::adaptive_sort(l.begin(), l.end(), by_key);
+	assert(std::equal(v.begin(), v.end(), l.begin()));
+
+	tests::instrument::counters ops;
+	auto comp = tests::instrument::make_counting_compare(by_key);
+	tests::instrument::record(ops, [&v, &comp] {
+		tests::adaptive_sort(v.begin(), v.end(), comp); });
+	assert(ops.comparisons == v.size() - 1);
+
+	// scratch is only taken once a merge needs it
+	tests::scratch_arena arena;
+	std::vector<item> distinct;
+	for (int i = 0; i < size; ++i)
+		distinct.emplace_back(i, i);
+	tests::adaptive_sort(distinct.begin(), distinct.end(), arena, by_key);
+	std::reverse(distinct.begin(), distinct.end());
+	tests::adaptive_sort(distinct.begin(), distinct.end(), arena, by_key);
+	assert(arena.allocations() == 0);
+	std::swap(distinct.front(), distinct[size / 2]);
+	tests::adaptive_sort(distinct.begin(), distinct.end(), arena, by_key);
+	assert(arena.allocations() == 1);
+	assert(std::is_sorted(distinct.begin(), distinct.end(), by_key));
+}
+
+using counted_string = std::basic_string<char, std::char_traits<char>,
+	tests::instrument::counting_allocator<char>>;
+
+// like test_type, but its string is too long for the small string buffer,
+// so every copy of it allocates
+struct long_string_type {
+	counted_string s;
+	int d;
+
+	long_string_type(int _d) : s("a string longer than any small string buffer"), d(_d) {}
+};
+
+bool operator<(const long_string_type& a, const long_string_type& b) {
+	return a.d < b.d;
+}
+
+// sorting heavy elements moves them and never copies a string
+void sort_allocation_test() {
+	std::vector<long_string_type> input;
+	for (int i = 0; i < 2000; ++i)
+		input.push_back(long_string_type(rand() % 500));
+
+	// a copy does allocate, so the checks below can fail
+	tests::instrument::counters copy_ops;
+	tests::instrument::record(copy_ops, [&input] { auto copy = input[0]; });
+	assert(copy_ops.allocations == 1);
+
+	auto check = [&input](auto sort) {
+		auto v = input;
+		tests::instrument::counters ops;
+		tests::instrument::record(ops, [&v, &sort] { sort(v.begin(), v.end()); });
+		assert(ops.allocations == 0);
+		assert(std::is_sorted(v.begin(), v.end()));
+	};
+
+	check([](auto first, auto last) { tests::quick_sort(first, last); });
+	check([](auto first, auto last) { tests::merge_sort(first, last); });
+	check([](auto first, auto last) { tests::adaptive_sort(first, last); });
+	check([](auto first, auto last) { tests::inplace_merge_sort(first, last, 0); });
+	check([](auto first, auto last) { tests::inplace_merge_sort(first, last, 1000); });
+	check([](auto first, auto last) { tests::indirect_sort(first, last, &long_string_type::d); });
+}
+
+// move-only elements: any copy in the sorts fails to compile
+template<typename C>
+void sort_move_only_test() {
+	C v1, v2;
+	for (int i = 0; i < 500; ++i) {
+		v1.push_back(std::make_unique<int>(rand()));
+		v2.push_back(std::make_unique<int>(rand()));
+	}
+
+	tests::quick_sort(v1.begin(), v1.end());
+	assert(std::is_sorted(v1.begin(), v1.end()));
+
+	tests::merge_sort(v2.begin(), v2.end());
+	assert(std::is_sorted(v2.begin(), v2.end()));
+}
+
+// one arena across calls: only growth may allocate, never a repeat size
+template<typename C>
+void merge_sort_arena_test() {
+	tests::scratch_arena arena;
+	C v;
+
+	for (int i = 0; i < 500; ++i) {
+		add(v, rand(), 0);
+		tests::merge_sort(v.begin(), v.end(), arena);
+		assert(std::is_sorted(v.begin(), v.end()));
+	}
+
+	auto allocations = arena.allocations();
+	for (int i = 0; i < 10; ++i) {
+		std::reverse(v.begin(), v.end());
+		tests::merge_sort(v.begin(), v.end(), arena);
+		assert(std::is_sorted(v.begin(), v.end()));
+	}
+	assert(arena.allocations() == allocations);
+
+	std::vector<int> scratch_owner;
+	scratch_owner.reserve(500);
+	std::reverse(v.begin(), v.end());
+	tests::merge_sort(v.begin(), v.end(), scratch_owner.data(), scratch_owner.capacity());
+	assert(std::is_sorted(v.begin(), v.end()));
+
+	// the other buffered sorts take the same arena or caller scratch
+	for (int i = 0; i < 10; ++i) {
+		for (auto& x : v)
+			x = rand();
+		tests::adaptive_sort(v.begin(), v.end(), arena);
+		assert(std::is_sorted(v.begin(), v.end()));
+	}
+	assert(arena.allocations() == allocations);
+
+	for (std::size_t capacity : { std::size_t(0), std::size_t(7), scratch_owner.capacity() }) {
+		for (auto& x : v)
+			x = rand();
+		tests::inplace_merge_sort(v.begin(), v.end(), scratch_owner.data(), capacity);
+		assert(std::is_sorted(v.begin(), v.end()));
+	}
+
+	for (auto& x : v)
+		x = rand();
+	tests::adaptive_sort(v.begin(), v.end(), scratch_owner.data(), scratch_owner.capacity());
+	assert(std::is_sorted(v.begin(), v.end()));
+}
+
+// sorts and searches by a projected key must match std:: ones on that key;
+// elements carry their original position, so the stable sorts must also
+// keep equal keys in order
+template<typename C>
+void projection_test() {
+	using item = std::pair<int, int>;
+	auto by_key = [](const item& a, const item& b) { return a.first < b.first; };
+	auto same_key = [](const item& a, const item& b) { return a.first == b.first; };
+	C c;
+	for (int i = 0; i < 500; ++i)
+		c.push_back(item(rand() % 100, i));
+
+	std::vector<item> v(c.begin(), c.end());
+	std::stable_sort(v.begin(), v.end(), by_key);
+
+	// merge_sort sorts random access leaves with a network
+	const bool merge_sort_stable = !std::is_same<
+		typename std::iterator_traits<typename C::iterator>::iterator_category,
+		std::random_access_iterator_tag>::value;
+
+	C c1(c), c2(c), c3(c), c4(c);
+	tests::quick_sort(c1.begin(), c1.end(), std::less<int>(), &item::first);
+	tests::merge_sort(c2.begin(), c2.end(), std::less<int>(), &item::first);
+	tests::adaptive_sort(c3.begin(), c3.end(), std::less<int>(),
+		[](const item& x) { return x.first; });
+	tests::indirect_sort(c4.begin(), c4.end(), &item::first);
+	assert(std::equal(v.begin(), v.end(), c1.begin(), c1.end(), same_key));
+	assert(std::is_permutation(v.begin(), v.end(), c1.begin(), c1.end()));
+	if (merge_sort_stable)
+		assert(std::equal(v.begin(), v.end(), c2.begin(), c2.end()));
+	else
+		assert(std::equal(v.begin(), v.end(), c2.begin(), c2.end(), same_key)
+			&& std::is_permutation(v.begin(), v.end(), c2.begin(), c2.end()));
+	assert(std::equal(v.begin(), v.end(), c3.begin(), c3.end()));
+	assert(std::equal(v.begin(), v.end(), c4.begin(), c4.end()));
+
+	// an integer capacity must reach the scratch overload, not the projection one
+	C c5(c);
+	item buffer[16];
+	auto c5_last = std::next(c5.begin(), 16);
+	tests::merge_sort(c5.begin(), c5_last, buffer, 16);
+	assert(std::is_sorted(c5.begin(), c5_last));
+
+	for (int x = -1; x <= 101; ++x) {
+		auto range = std::equal_range(v.begin(), v.end(), item(x, 0), by_key);
+		auto first = tests::lower_bound(c1.begin(), c1.end(), x, std::less<int>(), &item::first);
+		auto last = tests::upper_bound(c1.begin(), c1.end(), x, std::less<int>(), &item::first);
+		assert(std::distance(c1.begin(), first) == range.first - v.begin());
+		assert(std::distance(c1.begin(), last) == range.second - v.begin());
+		auto range2 = tests::equal_range(c1.begin(), c1.end(), x, std::less<int>(), &item::first);
+		assert(range2.first == first && range2.second == last);
+		assert(tests::binary_search(c1.begin(), c1.end(), x, std::less<int>(), &item::first)
+			== (range.first != range.second));
+	}
+}
+
+// pipelines must match the same stages materialized with std:: algorithms
+template<typename C>
+void range_pipeline_test() {
+	C c;
+	for (int i = 0; i < 1000; ++i)
+		c.push_back(rand() % 1000);
+	std::vector<int> v(c.begin(), c.end());
+
+	auto triple = [](int x) { return x * 3 + 1; };
+	auto even = [](int x) { return x % 2 == 0; };
+
+	std::vector<int> tripled, filtered;
+	std::transform(v.begin(), v.end(), std::back_inserter(tripled), triple);
+	std::copy_if(tripled.begin(), tripled.end(), std::back_inserter(filtered), even);
+
+	auto p = tests::make_pipeline(c).transform(triple).filter(even);
+	assert(p.count() == filtered.size());
+	assert(p.reduce(0LL) == std::accumulate(filtered.begin(), filtered.end(), 0LL));
+	assert(p.transform_reduce(0LL, std::plus<>(), [](int x) { return x / 2; })
+		== std::accumulate(filtered.begin(), filtered.end(), 0LL,
+			[](long long a, int x) { return a + x / 2; }));
+
+	std::vector<int> out(filtered.size());
+	assert(p.copy_to(out.begin()) == out.end());
+	assert(out == filtered);
+
+	// take stops reading the source once it has its elements; take(0) reads
+	// none
+	for (std::size_t n : { 0, 1, 10, 600, 5000 }) {
+		std::size_t calls = 0;
+		std::vector<int> taken;
+		tests::make_pipeline(c)
+			.transform([&calls, &triple](int x) { ++calls; return triple(x); })
+			.take(n)
+			.filter(even)
+			.copy_to(std::back_inserter(taken));
+		auto expected_end = tripled.begin() + std::min(n, tripled.size());
+		std::vector<int> expected;
+		std::copy_if(tripled.begin(), expected_end, std::back_inserter(expected), even);
+		assert(taken == expected);
+		assert(calls == std::min(n, tripled.size()));
+
+		auto first_even = tests::make_pipeline(c).transform(triple).filter(even).take(n).count();
+		assert(first_even == std::min(n, filtered.size()));
+	}
+
+	// enumerate hands out references to the source elements
+	tests::make_pipeline(c).enumerate().filter([](const auto& e) { return e.first % 3 == 0; })
+		.reduce(0, [](int, std::pair<std::size_t, int&> e) { e.second = -e.second; return 0; });
+	std::size_t i = 0;
+	for (int x : c) {
+		assert(x == (i % 3 == 0 ? -v[i] : v[i]));
+		++i;
+	}
+	assert(tests::make_pipeline(c).enumerate().take(5)
+		.transform_reduce(std::size_t(0), std::plus<>(), [](const auto& e) { return e.first; }) == 10);
+}
+
+// inplace_merge and inplace_merge_sort are stable with any scratch, down to none
+template<typename C>
+void inplace_merge_test() {
+	using item = std::pair<int, int>;
+	auto by_key = [](const item& a, const item& b) { return a.first < b.first; };
+	const std::size_t limits[] = { 0, 1, 7, 1000 };
+	tests::scratch_arena arena;
+
+	for (int n : { 0, 1, 2, 3, 50, 777 }) {
+		std::vector<item> v;
+		for (int i = 0; i < n; ++i)
+			v.push_back(item(rand() % 20, i));
+
+		std::vector<item> sorted(v);
+		std::stable_sort(sorted.begin(), sorted.end(), by_key);
+		for (auto limit : limits) {
+			C c(v.begin(), v.end());
+			tests::inplace_merge_sort(c.begin(), c.end(), limit, by_key);
+			assert(std::equal(sorted.begin(), sorted.end(), c.begin(), c.end()));
+		}
+
+		int split = rand() % (n + 1);
+		std::vector<item> runs(v);
+		std::stable_sort(runs.begin(), runs.begin() + split, by_key);
+		std::stable_sort(runs.begin() + split, runs.end(), by_key);
+		std::vector<item> merged(runs);
+		std::inplace_merge(merged.begin(), merged.begin() + split, merged.end(), by_key);
+
+		for (auto limit : limits) {
+			C c(runs.begin(), runs.end());
+			tests::inplace_merge(c.begin(), std::next(c.begin(), split), c.end(),
+				arena.get<item>(limit), limit, by_key);
+			assert(std::equal(merged.begin(), merged.end(), c.begin(), c.end()));
+		}
+
+		C c(runs.begin(), runs.end());
+		tests::inplace_merge(c.begin(), std::next(c.begin(), split), c.end(), by_key);
+		assert(std::equal(merged.begin(), merged.end(), c.begin(), c.end()));
+	}
+}
+
+// indirect_sort is stable and moves each element once, plus once per cycle
+template<typename C>
+void indirect_sort_test() {
+	using item = std::pair<int, tests::instrument::tracked<int>>;
+	C c;
+	std::vector<std::pair<int, int>> expected;
+	for (int i = 0; i < 2000; ++i) {
+		int key = rand() % 50;
+		c.emplace_front(key, tests::instrument::tracked<int>(i));
+		expected.emplace_back(key, i);
+	}
+	std::reverse(expected.begin(), expected.end());
+	std::stable_sort(expected.begin(), expected.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+
+	tests::instrument::counters ops;
+	tests::instrument::record(ops, [&c] {
+		tests::indirect_sort(c.begin(), c.end(), &item::first); });
+	assert(std::equal(expected.begin(), expected.end(), c.begin(),
+		[](const std::pair<int, int>& e, const item& x) {
+		return e.first == x.first && e.second == x.second.value();
+	}));
+	assert(ops.copies == 0 && ops.swaps == 0);
+	assert(ops.moves <= expected.size() * 3 / 2);
+}
+
+void sort_network_test() {
+	// 0-1 principle: a network sorting every 0/1 input sorts every input;
+	// exhaustive up to 20 elements, sampled for the larger networks
+	std::mt19937 gen(7);
+	std::vector<int> v;
+	for (std::size_t n = 0; n <= tests::sort_network_max; ++n) {
+		std::uint32_t patterns = n <= 20 ? std::uint32_t(1) << n : 1u << 18;
+		for (std::uint32_t p = 0; p < patterns; ++p) {
+			std::uint32_t bits = n <= 20 ? p : static_cast<std::uint32_t>(gen());
+			v.clear();
+			for (std::size_t i = 0; i < n; ++i)
+				v.push_back((bits >> i) & 1);
+			tests::sort_network(v.begin(), v.end());
+			assert(std::is_sorted(v.begin(), v.end()));
+		}
+	}
+
+	for (std::size_t n = 0; n <= tests::sort_network_max; ++n) {
+		for (int i = 0; i < 100; ++i) {
+			std::vector<int> v1;
+			for (std::size_t j = 0; j < n; ++j)
+				v1.push_back(rand() % 20);
+			auto v2 = v1;
+			std::sort(v1.begin(), v1.end());
+			tests::sort_network(v2.begin(), v2.end());
+			assert(v1 == v2);
+		}
+	}
 }
 
 template<typename C>
@@ -243,79 +694,1023 @@ void merge_test(std::input_iterator_tag) {
 	assert(res1.str() == res2.str());
 }
 
+// output matches std::merge, ties included; random access inputs merge a
+// few keys into many in O(m log(n / m)) comparisons
+template<typename C>
+void merge_skewed_test() {
+	using item = std::pair<int, int>;
+	auto by_key = [](const item& a, const item& b) { return a.first < b.first; };
+	auto sorted_items = [&by_key](int count, int keys, int tag) {
+		std::vector<item> v;
+		for (int i = 0; i < count; ++i)
+			v.push_back(item(rand() % keys, tag));
+		std::sort(v.begin(), v.end(), by_key);
+		return C(v.begin(), v.end());
+	};
+
+	const int shapes[][3] = { { 500, 500, 10 }, { 20000, 20, 10000 }, { 20, 20000, 10000 } };
+	for (auto& shape : shapes) {
+		C c1 = sorted_items(shape[0], shape[2], 1);
+		C c2 = sorted_items(shape[1], shape[2], 2);
+
+		std::vector<item> res1, res2;
+		std::merge(c1.begin(), c1.end(), c2.begin(), c2.end(), std::back_inserter(res1), by_key);
+
+		tests::instrument::counters ops;
+		auto comp = tests::instrument::make_counting_compare(by_key);
+		tests::instrument::record(ops, [&c1, &c2, &res2, &comp] {
+			tests::merge(c1.begin(), c1.end(), c2.begin(), c2.end(), std::back_inserter(res2), comp);
+		});
+		assert(res1 == res2);
+
+		if (std::is_same<typename tests::iterator_traits<typename C::iterator>::iterator_category,
+			tests::random_access_iterator_tag>::value && shape[0] != shape[1])
+			assert(ops.comparisons < 1000);
+	}
+}
+
+template<typename C>
+void partition_pivot_test() {
+	for (int size = 1; size < 200; size += 7) {
+		for (int unique = 1; unique < 10; unique += 3) {
+			C c;
+			for (int i = 0; i < size; ++i)
+				add(c, rand() % unique);
+
+			auto pivot_pos = std::next(c.begin(), rand() % size);
+			int pivot = *pivot_pos;
+			auto parts = tests::partition_pivot(c.begin(), c.end(), pivot_pos);
+
+			assert(std::distance(c.begin(), parts.equal_first) == parts.less_count);
+			assert(std::distance(parts.equal_first, parts.equal_last) == parts.equal_count);
+			assert(std::all_of(c.begin(), parts.equal_first, [pivot](int x) { return x < pivot; }));
+			assert(std::all_of(parts.equal_first, parts.equal_last, [pivot](int x) { return x == pivot; }));
+			assert(std::all_of(parts.equal_last, c.end(), [pivot](int x) { return pivot < x; }));
+		}
+	}
+
+	// few unique keys: every level retires a whole key, so the cost is linear
+	std::vector<tests::instrument::tracked<int>> v;
+	for (int i = 0; i < 100'000; ++i)
+		v.emplace_back(rand() % 4);
+
+	tests::instrument::counters ops;
+	tests::instrument::record(ops, [&v] { tests::quick_sort(v.begin(), v.end()); });
+	assert(std::is_sorted(v.begin(), v.end()));
+	assert(ops.comparisons < 10 * v.size());
+}
+
 template<typename C>
 void partition_test(int size) {
+	using tests::instrument::record;
+	measure_ops ops(std::string("partition_test<") + typeid(C).name() + ">");
 	C c;
 
 	for (int i = 0; i < size; ++i)
 		add(c, rand());
 
-	auto pred = [](int x) {
+	auto pred = tests::instrument::make_counting_compare([](int x) {
 		return x % 2;
-	};
+	});
 
-	assert(std::is_partitioned(c.begin(), c.end(), pred) == tests::is_partitioned(c.begin(), c.end(), pred));
+	auto first = tests::instrument::make_counting_iterator(c.begin());
+	auto last = tests::instrument::make_counting_iterator(c.end());
+
+	assert(record(ops.std_ops, [&] { return std::is_partitioned(first, last, pred); })
+		== record(ops.tests_ops, [&] { return tests::is_partitioned(first, last, pred); }));
 
 	std::partition(c.begin(), c.end(), pred);
 
-	assert(std::partition_point(c.begin(), c.end(), pred) == tests::partition_point(c.begin(), c.end(), pred));
+	assert(record(ops.std_ops, [&] { return std::partition_point(first, last, pred); })
+		== record(ops.tests_ops, [&] { return tests::partition_point(first, last, pred); }));
 
-	assert(std::is_partitioned(c.begin(), c.end(), pred) == tests::is_partitioned(c.begin(), c.end(), pred));
+	assert(record(ops.std_ops, [&] { return std::is_partitioned(first, last, pred); })
+		== record(ops.tests_ops, [&] { return tests::is_partitioned(first, last, pred); }));
 }
 
-void run_binary_search_tests() {
-	measure_time a("run_binary_search_tests");
+template<typename C>
+void selection_test(int size) {
+	C c;
+
+	for (int i = 0; i < size; ++i)
+		add(c, rand() % 100);
+
+	std::vector<int> v(c.begin(), c.end());
+	const int ranks[] = { 0, size / 3, size / 2, size - 1 };
+
+	for (int n : ranks) {
+		std::vector<int> v1(v);
+		std::nth_element(v1.begin(), v1.begin() + n, v1.end());
+
+		C c1(c);
+		auto nth = std::next(c1.begin(), n);
+		tests::nth_element(c1.begin(), nth, c1.end());
+		assert(*nth == v1[n]);
+		assert(std::none_of(c1.begin(), nth, [&nth](int x) { return *nth < x; }));
+		assert(std::none_of(nth, c1.end(), [&nth](int x) { return x < *nth; }));
+
+		// median-of-medians from the first level
+		C c2(c);
+		tests::nth_element_impl(c2.begin(), c2.end(), n, 0);
+		assert(*std::next(c2.begin(), n) == v1[n]);
+
+		std::vector<int> v3(v);
+		std::partial_sort(v3.begin(), v3.begin() + n, v3.end());
+
+		C c3(c);
+		tests::partial_sort(c3.begin(), std::next(c3.begin(), n), c3.end());
+		assert(std::equal(v3.begin(), v3.begin() + n, c3.begin()));
+
+		std::vector<int> d1(n), d2(n);
+		auto r1 = std::partial_sort_copy(c.begin(), c.end(), d1.begin(), d1.end());
+		auto r2 = tests::partial_sort_copy(c.begin(), c.end(), d2.begin(), d2.end());
+		assert(r1 - d1.begin() == r2 - d2.begin());
+		assert(d1 == d2);
+
+		std::vector<int> d3(n);
+		std::partial_sort_copy(c.begin(), c.end(), d3.begin(), d3.end(), std::greater<int>());
+
+		tests::top_k<int, std::greater<int>> top(n);
+		top.push(c.begin(), c.end());
+		assert(top.sorted() == d3);
+	}
+}
+
+void selection_test(std::input_iterator_tag) {
+	std::stringstream ss1, ss2;
+	for (int i = 0; i < 1000; ++i) {
+		int x = rand();
+		ss1 << x << ' ';
+		ss2 << x << ' ';
+	}
+
+	std::vector<int> res1(100);
+	std::partial_sort_copy(std::istream_iterator<int>{ss1}, std::istream_iterator<int>{},
+		res1.begin(), res1.end(), std::greater<int>());
 
-	binary_search_tests<std::vector<int>, int>();
-	binary_search_tests<std::list<int>, int>();
-	binary_search_tests<std::forward_list<int>, int>();
+	tests::top_k<int, std::greater<int>> top(100);
+	top.push(std::istream_iterator<int>{ss2}, std::istream_iterator<int>{});
 
-	binary_search_tests<std::vector<test_type>, test_type>();
-	binary_search_tests<std::list<test_type>, test_type>();
-	binary_search_tests<std::forward_list<test_type>, test_type>();
+	assert(top.sorted() == res1);
 }
 
-void merge_tests() {
+void search_cache_test() {
+	std::vector<int> v;
+	for (int i = 0; i < 1000; ++i)
+		v.push_back(rand() % 300);
+	std::sort(v.begin(), v.end());
+
+	const std::size_t levels[] = { 0, 1, 4, 10, 20 };
+	for (auto level : levels) {
+		tests::search_cache<std::vector<int>::iterator> cache(v.begin(), v.end(), level);
+		for (int x = -5; x < 305; ++x) {
+			auto range = std::equal_range(v.begin(), v.end(), x);
+			auto query = cache.equal_range_query(x);
+			assert(query.lower == range.first && query.upper == range.second);
+			assert(query.found == std::binary_search(v.begin(), v.end(), x));
+			assert(query.count == range.second - range.first);
+		}
+	}
+}
+
+// small nodes, so edits and searches keep crossing node boundaries
+void unrolled_list_test() {
+	std::list<int> l;
+	tests::unrolled_list<int, 4> u;
+
+	for (int i = 0; i < 2000; ++i) {
+		int x = rand() % 100;
+		auto pos = static_cast<std::ptrdiff_t>(rand() % (l.size() + 1));
+		switch (rand() % 5) {
+		case 0:
+			l.push_back(x);
+			u.push_back(x);
+			break;
+		case 1:
+			l.push_front(x);
+			u.push_front(x);
+			break;
+		case 2: {
+			auto it = u.insert(std::next(u.begin(), pos), x);
+			l.insert(std::next(l.begin(), pos), x);
+			assert(*it == x);
+			assert(std::distance(u.begin(), it) == pos);
+			break;
+		}
+		case 3:
+			if (pos < static_cast<std::ptrdiff_t>(l.size())) {
+				auto it = u.erase(std::next(u.begin(), pos));
+				l.erase(std::next(l.begin(), pos));
+				assert(std::distance(u.begin(), it) == pos);
+			}
+			break;
+		case 4: {
+			tests::unrolled_list<int, 4> other{ x, x + 1, x + 2, x + 3, x + 4 };
+			u.splice(std::next(u.begin(), pos), other);
+			l.insert(std::next(l.begin(), pos), { x, x + 1, x + 2, x + 3, x + 4 });
+			assert(other.empty());
+			break;
+		}
+		}
+
+		assert(u.size() == l.size());
+		assert(std::equal(l.begin(), l.end(), u.begin(), u.end()));
+		assert(std::equal(l.rbegin(), l.rend(),
+			std::make_reverse_iterator(u.end()), std::make_reverse_iterator(u.begin())));
+	}
+
+	auto copy = u;
+	auto moved = std::move(copy);
+	assert(copy.empty() && std::equal(l.begin(), l.end(), moved.begin(), moved.end()));
+
+	// segment-aware algorithms against the std:: ones on subranges
+	auto pred = [](int x) { return x % 3 == 0; };
+	for (int i = 0; i < 100; ++i) {
+		auto size = static_cast<std::ptrdiff_t>(l.size());
+		auto a = rand() % (size + 1);
+		auto b = a + rand() % (size - a + 1);
+		auto l_first = std::next(l.begin(), a), l_last = std::next(l.begin(), b);
+		auto u_first = tests::next(u.begin(), a), u_last = tests::next(u.begin(), b);
+		assert(std::distance(u.begin(), u_first) == a && std::distance(u.begin(), u_last) == b);
+		assert(tests::distance(u_first, u_last) == b - a);
+
+		int s1 = 0, s2 = 0;
+		std::for_each(l_first, l_last, [&s1](int x) { s1 += x; });
+		tests::for_each(u_first, u_last, [&s2](int x) { s2 += x; });
+		assert(s1 == s2);
+		assert(std::count_if(l_first, l_last, pred) == tests::count_if(u_first, u_last, pred));
+	}
+
+	auto p = tests::partition(u.begin(), u.end(), pred);
+	assert(std::is_partitioned(u.begin(), u.end(), pred));
+	assert(std::distance(u.begin(), p) == std::count_if(l.begin(), l.end(), pred));
+
+	tests::merge_sort(u.begin(), u.end());
+	l.sort();
+	assert(std::equal(l.begin(), l.end(), u.begin(), u.end()));
+	for (int x = -1; x <= 101; ++x) {
+		assert(std::distance(l.begin(), std::lower_bound(l.begin(), l.end(), x))
+			== std::distance(u.begin(), tests::lower_bound(u.begin(), u.end(), x)));
+		assert(std::distance(l.begin(), std::upper_bound(l.begin(), l.end(), x))
+			== std::distance(u.begin(), tests::upper_bound(u.begin(), u.end(), x)));
+	}
+}
+
+// erasing most elements must leave every node but the last at least half full
+void unrolled_list_erase_test() {
+	using list_type = tests::unrolled_list<int, 16>;
+	using traits = tests::segmented_iterator_traits<list_type::iterator>;
+	std::list<int> l;
+	list_type u;
+	for (int i = 0; i < 2000; ++i) {
+		l.push_back(i);
+		u.push_back(i);
+	}
+
+	while (l.size() > 100) {
+		auto pos = rand() % static_cast<int>(l.size());
+		auto l_next = l.erase(std::next(l.begin(), pos));
+		auto u_next = u.erase(std::next(u.begin(), pos));
+		assert(std::distance(u.begin(), u_next) == std::distance(l.begin(), l_next));
+	}
+	assert(std::equal(l.begin(), l.end(), u.begin(), u.end()));
+
+	std::size_t nodes = 0;
+	auto last = traits::segment(u.end());
+	for (auto seg = traits::segment(u.begin()); seg != last; seg = traits::next_segment(seg)) {
+		auto count = traits::end(seg) - traits::begin(seg);
+		assert(count > 0 && (count >= 8 || traits::next_segment(seg) == last));
+		++nodes;
+	}
+	assert(nodes <= l.size() / 8 + 1);
+}
+
+// every query must match the std:: one on the same sorted vector
+template<typename T>
+void check_int_index(const tests::dense_int_index<typename std::vector<T>::iterator>& index,
+	std::vector<T>& v, T x) {
+	auto range = std::equal_range(v.begin(), v.end(), x);
+	assert(index.lower_bound(x) == range.first);
+	assert(index.upper_bound(x) == range.second);
+	assert(index.binary_search(x) == std::binary_search(v.begin(), v.end(), x));
+
+	auto query = index.equal_range_query(x);
+	assert(query.lower == range.first && query.upper == range.second);
+	assert(query.found == (range.first != range.second));
+	assert(query.count == range.second - range.first);
+}
+
+template<typename T>
+void dense_int_index_test(T lo, T hi, int size) {
+	std::vector<T> v;
+	for (int i = 0; i < size; ++i)
+		v.push_back(static_cast<T>(lo + rand() % (hi - lo + 1)));
+	std::sort(v.begin(), v.end());
+
+	tests::dense_int_index<typename std::vector<T>::iterator> index(v.begin(), v.end());
+	assert(index.is_dense());
+	for (T x = lo - 3; x <= hi + 3; ++x)
+		check_int_index(index, v, x);
+}
+
+// keys spread over too wide a range are binary searched, not indexed
+template<typename T>
+void sparse_int_index_test(std::vector<T> v) {
+	// parenthesized past the min and max macros of Windows.h
+	const T lowest = (std::numeric_limits<T>::min)(), highest = (std::numeric_limits<T>::max)();
+	std::sort(v.begin(), v.end());
+
+	tests::dense_int_index<typename std::vector<T>::iterator> index(v.begin(), v.end());
+	assert(!index.is_dense());
+	std::vector<T> keys = { lowest, highest };
+	for (T x : v) {
+		keys.push_back(x);
+		if (x != lowest)
+			keys.push_back(x - 1);
+		if (x != highest)
+			keys.push_back(x + 1);
+	}
+	for (T x : keys)
+		check_int_index(index, v, x);
+}
+
+void dense_int_index_test() {
+	// the fallback for CPUs without POPCNT against a bit-by-bit count
+	std::mt19937_64 gen(11);
+	for (int i = 0; i < 1000; ++i) {
+		std::uint64_t x = i < 2 ? std::uint64_t(0) - i : gen() >> (i % 64);
+		std::size_t ones = 0;
+		for (auto y = x; y; y >>= 1)
+			ones += y & 1;
+		assert(tests::popcount_portable(x) == ones && tests::popcount(x) == ones);
+	}
+
+	dense_int_index_test<int>(0, 10, 0);
+	dense_int_index_test<int>(5, 5, 1);
+	dense_int_index_test<int>(-500, 500, 100);
+	dense_int_index_test<int>(-500, 500, 5000);
+	dense_int_index_test<int>(0, 3000, 2000);
+	dense_int_index_test<unsigned>(10, 2000, 3000);
+	dense_int_index_test<long long>(-100, 100, 50);
+
+	using int_limits = std::numeric_limits<int>;
+	using int64_limits = std::numeric_limits<std::int64_t>;
+	sparse_int_index_test<int>({ (int_limits::min)(), 0, 0, (int_limits::max)() });
+	sparse_int_index_test<int>({ 0, 1, 2, 1 << 20 });
+	sparse_int_index_test<std::int64_t>({ (int64_limits::min)(), -1, 5, 5, (int64_limits::max)() });
+	sparse_int_index_test<std::uint64_t>({ 0, 1, 1, (std::numeric_limits<std::uint64_t>::max)() });
+}
+
+// readers must only ever see sorted, growing snapshots while the writer merges
+void sorted_index_test() {
+	tests::sorted_index<int> index(256);
+	std::atomic<bool> done(false);
+
+	auto read_loop = [&index, &done]() {
+		tests::sorted_index<int>::reader r(index);
+		std::size_t last_size = 0;
+		while (!done.load()) {
+			r.read([&last_size](const std::vector<int>& s) {
+				assert(std::is_sorted(s.begin(), s.end()));
+				assert(s.size() >= last_size);
+				last_size = s.size();
+			});
+		}
+	};
+
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 4; ++i)
+		readers.emplace_back(read_loop);
+
+	std::vector<int> inserted;
+	for (int i = 0; i < 20'000; ++i) {
+		inserted.push_back(rand() % 1000);
+		index.insert(inserted.back());
+	}
+	index.flush();
+
+	done.store(true);
+	for (auto& t : readers)
+		t.join();
+
+	index.flush();
+	assert(index.pending_reclaim() == 0);
+
+	std::sort(inserted.begin(), inserted.end());
+	tests::sorted_index<int>::reader r(index);
+	assert(r.size() == inserted.size());
+	for (int x = -1; x <= 1000; ++x) {
+		auto range = std::equal_range(inserted.begin(), inserted.end(), x);
+		assert(r.count(x) == static_cast<std::size_t>(range.second - range.first));
+		assert(r.contains(x) == (range.first != range.second));
+	}
+}
+
+// time each test task took, gathered across workers
+struct test_times {
+	std::mutex m;
+	std::vector<std::pair<std::string, double>> times;
+
+	void add(std::string name, double seconds) {
+		std::lock_guard<std::mutex> lock(m);
+		times.emplace_back(std::move(name), seconds);
+	}
+};
+
+template<typename C>
+std::string test_name(const char* name) {
+	return std::string(name) + "<" + typeid(C).name() + ">";
+}
+
+// a group of tests, each spawned as its own timed task; nested when the
+// group itself runs as a task
+class test_group {
+public:
+	explicit test_group(test_times& _times) : times(_times) {}
+
+	// Records only the test's own time: a task waiting on others runs them
+	// on its thread, and their time is left to their own records.
+	template<typename F>
+	void add(std::string name, F f) {
+		auto& t = times;
+		tasks.push_back(tests::create_task([&t, name, f]() {
+			auto outer = nested_seconds();
+			nested_seconds() = 0;
+			auto start = std::chrono::steady_clock::now();
+			f();
+			std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+			t.add(name, d.count() - nested_seconds());
+			nested_seconds() = outer + d.count();
+		}));
+	}
+
+	void wait() {
+		for (auto& t : tasks)
+			t.get();
+	}
+
+private:
+	// time of the tests run inside the one running on this thread
+	static double& nested_seconds() {
+		thread_local double seconds = 0;
+		return seconds;
+	}
+
+	test_times& times;
+	std::vector<tests::task<void>> tasks;
+};
+
+void run_binary_search_tests(test_times& times) {
+	measure_time a("run_binary_search_tests");
+	test_group g(times);
+
+	g.add(test_name<std::vector<int>>("binary_search_tests"), binary_search_tests<std::vector<int>, int>);
+	g.add(test_name<std::list<int>>("binary_search_tests"), binary_search_tests<std::list<int>, int>);
+	g.add(test_name<std::forward_list<int>>("binary_search_tests"), binary_search_tests<std::forward_list<int>, int>);
+	g.add(test_name<tests::unrolled_list<int>>("binary_search_tests"), binary_search_tests<tests::unrolled_list<int>, int>);
+
+	g.add(test_name<std::vector<test_type>>("binary_search_tests"), binary_search_tests<std::vector<test_type>, test_type>);
+	g.add(test_name<std::list<test_type>>("binary_search_tests"), binary_search_tests<std::list<test_type>, test_type>);
+	g.add(test_name<std::forward_list<test_type>>("binary_search_tests"), binary_search_tests<std::forward_list<test_type>, test_type>);
+	g.add(test_name<tests::unrolled_list<test_type>>("binary_search_tests"), binary_search_tests<tests::unrolled_list<test_type>, test_type>);
+
+	g.add("unrolled_list_test", unrolled_list_test);
+	g.add("unrolled_list_erase_test", unrolled_list_erase_test);
+	g.add("search_cache_test", search_cache_test);
+	g.add("dense_int_index_test", []() { dense_int_index_test(); });
+	g.add("sorted_index_test", sorted_index_test);
+
+	g.add(test_name<std::vector<int>>("range_pipeline_test"), range_pipeline_test<std::vector<int>>);
+	g.add(test_name<std::list<int>>("range_pipeline_test"), range_pipeline_test<std::list<int>>);
+	g.add(test_name<std::deque<int>>("range_pipeline_test"), range_pipeline_test<std::deque<int>>);
+	g.add(test_name<tests::unrolled_list<int>>("range_pipeline_test"), range_pipeline_test<tests::unrolled_list<int>>);
+	g.wait();
+}
+
+void merge_tests(test_times& times) {
 	measure_time a("merge_tests");
-	merge_test<std::vector<int>>();
-	merge_test<std::list<int>>();
-	merge_test<std::forward_list<int>>();
-	merge_test(std::input_iterator_tag{});
+	test_group g(times);
+	g.add(test_name<std::vector<int>>("merge_test"), merge_test<std::vector<int>>);
+	g.add(test_name<std::list<int>>("merge_test"), merge_test<std::list<int>>);
+	g.add(test_name<std::forward_list<int>>("merge_test"), merge_test<std::forward_list<int>>);
+	g.add("merge_test<istream_iterator>", []() { merge_test(std::input_iterator_tag{}); });
+	g.add(test_name<std::vector<std::pair<int, int>>>("merge_skewed_test"), merge_skewed_test<std::vector<std::pair<int, int>>>);
+	g.add(test_name<std::list<std::pair<int, int>>>("merge_skewed_test"), merge_skewed_test<std::list<std::pair<int, int>>>);
+	g.wait();
 }
 
-void sort_tests() {
+void sort_tests(test_times& times) {
 	measure_time a("sort_tests");
-	auto t1 = create_task(sort_test<std::vector<int>>);
-	auto t2 = create_task(sort_test<std::list<int>>);
-	auto t3 = create_task(sort_test<std::forward_list<int>>);
+	test_group g(times);
+	using tracked = tests::instrument::tracked<int>;
+	using tracked_item = std::pair<int, tracked>;
+	using int_pair = std::pair<int, int>;
+
+	g.add(test_name<std::vector<int>>("sort_test"), sort_test<std::vector<int>>);
+	g.add(test_name<std::list<int>>("sort_test"), sort_test<std::list<int>>);
+	g.add(test_name<std::forward_list<int>>("sort_test"), sort_test<std::forward_list<int>>);
+	g.add(test_name<tests::unrolled_list<int>>("sort_test"), sort_test<tests::unrolled_list<int>>);
+
+	g.add(test_name<std::vector<tracked>>("sort_test"), sort_test<std::vector<tracked>>);
+	g.add(test_name<std::list<tracked>>("sort_test"), sort_test<std::list<tracked>>);
+	g.add(test_name<std::forward_list<tracked>>("sort_test"), sort_test<std::forward_list<tracked>>);
+	g.add(test_name<tests::unrolled_list<tracked>>("sort_test"), sort_test<tests::unrolled_list<tracked>>);
+
+	g.add(test_name<std::vector<std::unique_ptr<int>>>("sort_move_only_test"), sort_move_only_test<std::vector<std::unique_ptr<int>>>);
+	g.add(test_name<std::list<std::unique_ptr<int>>>("sort_move_only_test"), sort_move_only_test<std::list<std::unique_ptr<int>>>);
+	g.add(test_name<tests::unrolled_list<std::unique_ptr<int>>>("sort_move_only_test"), sort_move_only_test<tests::unrolled_list<std::unique_ptr<int>>>);
+
+	g.add(test_name<std::vector<int>>("merge_sort_arena_test"), merge_sort_arena_test<std::vector<int>>);
+	g.add(test_name<std::list<int>>("merge_sort_arena_test"), merge_sort_arena_test<std::list<int>>);
+	g.add(test_name<tests::unrolled_list<int>>("merge_sort_arena_test"), merge_sort_arena_test<tests::unrolled_list<int>>);
+
+	g.add(test_name<std::vector<std::pair<int, int>>>("projection_test"), projection_test<std::vector<std::pair<int, int>>>);
+	g.add(test_name<std::list<std::pair<int, int>>>("projection_test"), projection_test<std::list<std::pair<int, int>>>);
+	g.add(test_name<std::deque<tracked_item>>("indirect_sort_test"), indirect_sort_test<std::deque<tracked_item>>);
+	g.add(test_name<std::forward_list<tracked_item>>("indirect_sort_test"), indirect_sort_test<std::forward_list<tracked_item>>);
+
+	g.add(test_name<std::vector<int_pair>>("inplace_merge_test"), inplace_merge_test<std::vector<int_pair>>);
+	g.add(test_name<std::list<int_pair>>("inplace_merge_test"), inplace_merge_test<std::list<int_pair>>);
+	g.add(test_name<std::forward_list<int_pair>>("inplace_merge_test"), inplace_merge_test<std::forward_list<int_pair>>);
+	g.add(test_name<tests::unrolled_list<int_pair>>("inplace_merge_test"), inplace_merge_test<tests::unrolled_list<int_pair>>);
+
+	g.add("sort_network_test", sort_network_test);
+	g.add("sort_allocation_test", sort_allocation_test);
+	g.add("adaptive_sort_test", adaptive_sort_test);
+	g.wait();
+}
 
-	t1.get();
-	t2.get();
-	t3.get();
+const int test_sizes[] = { 100, 500, 2000 };
+
+template<typename C>
+void add_partition_tests(test_group& g) {
+	for (int size : test_sizes)
+		g.add(test_name<C>("partition_test") + "(" + std::to_string(size) + ")",
+			[size]() { partition_test<C>(size); });
+	g.add(test_name<C>("partition_pivot_test"), partition_pivot_test<C>);
 }
 
-void partition_tests() {
+void partition_tests(test_times& times) {
 	measure_time a("partition_tests");
-	partition_test<std::vector<int>>(500);
-	partition_test<std::list<int>>(500);
-	partition_test<std::forward_list<int>>(500);
+	test_group g(times);
+	add_partition_tests<std::vector<int>>(g);
+	add_partition_tests<std::list<int>>(g);
+	add_partition_tests<std::forward_list<int>>(g);
+	add_partition_tests<tests::unrolled_list<int>>(g);
+	g.wait();
+}
+
+template<typename C>
+void add_selection_tests(test_group& g) {
+	for (int size : test_sizes)
+		g.add(test_name<C>("selection_test") + "(" + std::to_string(size) + ")",
+			[size]() { selection_test<C>(size); });
+}
+
+void selection_tests(test_times& times) {
+	measure_time a("selection_tests");
+	test_group g(times);
+	add_selection_tests<std::vector<int>>(g);
+	add_selection_tests<std::list<int>>(g);
+	add_selection_tests<std::forward_list<int>>(g);
+	g.add("selection_test<istream_iterator>", []() { selection_test(std::input_iterator_tag{}); });
+	g.wait();
+}
+
+// user and kernel time of all threads of the process so far
+double cpu_seconds() {
+	FILETIME creation, exited, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user);
+	auto seconds = [](const FILETIME& t) {
+		ULARGE_INTEGER ticks;
+		ticks.LowPart = t.dwLowDateTime;
+		ticks.HighPart = t.dwHighDateTime;
+		return ticks.QuadPart / 1e7;
+	};
+	return seconds(kernel) + seconds(user);
 }
 
+// Every group runs as a task and fans its tests out as nested tasks. The
+// summary sets the wall time against the process CPU time from
+// GetProcessTimes.
 void run_tests() {
-	auto t1 = create_task(run_binary_search_tests);
-	auto t2 = create_task(merge_tests);
-	auto t3 = create_task(sort_tests);
-	auto t4 = create_task(partition_tests);
+	test_times times;
+	auto start = std::chrono::steady_clock::now();
+	auto cpu_start = cpu_seconds();
+
+	auto t1 = tests::create_task([&times]() { run_binary_search_tests(times); });
+	auto t2 = tests::create_task([&times]() { merge_tests(times); });
+	auto t3 = tests::create_task([&times]() { sort_tests(times); });
+	auto t4 = tests::create_task([&times]() { partition_tests(times); });
+	auto t5 = tests::create_task([&times]() { selection_tests(times); });
 
 	t1.get();
 	t2.get();
 	t3.get();
 	t4.get();
+	t5.get();
+
+	std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+	auto cpu = cpu_seconds() - cpu_start;
+	std::sort(times.times.begin(), times.times.end(),
+		[](const auto& a, const auto& b) { return a.second > b.second; });
+
+	// the group tasks only wait on their tests and are not recorded
+	double in_tests = 0;
+	for (auto& t : times.times) {
+		std::cout << "  " << t.first << ": " << t.second << "s.\n";
+		in_tests += t.second;
+	}
+	std::cout << "run_tests: " << times.times.size() << " tasks on "
+		<< tests::scheduler::default_scheduler().threads() << " threads, wall "
+		<< wall.count() << "s, cpu " << cpu << "s, in tests " << in_tests << "s.\n";
+}
+
+// peak working set of the process so far; it never comes back down
+std::size_t peak_memory() {
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.PeakWorkingSetSize;
+}
+
+// Merging and sorting under a shrinking scratch limit, against the buffered
+// merge_sort. Since the peak only grows, the runs go from the least scratch
+// to the most and each reports the growth over the peak before the first.
+// main runs it before the tests and the other benchmarks, whose own peaks
+// would hide the scratch; the baseline is taken once the inputs are in place.
+void inplace_merge_benchmark() {
+	int size = 1 << 22;
+
+#ifdef _DEBUG
+	size /= 1000;
+#endif
+
+	std::vector<int> input;
+	for (int i = 0; i < size; ++i)
+		input.push_back(rand());
+	std::vector<int> v(input.size());
+	auto mid = v.begin() + size / 2;
+
+	auto baseline = peak_memory();
+	auto report = [baseline](const char* name, std::size_t limit, double time) {
+		std::cout << "inplace_merge_benchmark " << name << " (scratch " << limit << "): "
+			<< time << "s, peak +" << (peak_memory() - baseline) / 1024 << " KB.\n";
+	};
+
+	const std::size_t limits[] = { 0, static_cast<std::size_t>(size / 64),
+		static_cast<std::size_t>(size / 2) };
+	for (auto limit : limits) {
+		// allocated untimed; it still counts toward the peak
+		std::vector<int> scratch(limit);
+		std::copy(input.begin(), input.end(), v.begin());
+		std::sort(v.begin(), mid);
+		std::sort(mid, v.end());
+		auto merge_time = time_call([&v, mid, &scratch, limit]() {
+			tests::inplace_merge(v.begin(), mid, v.end(), scratch.data(), limit);
+		});
+		assert(std::is_sorted(v.begin(), v.end()));
+		report("inplace_merge", limit, merge_time);
+
+		std::copy(input.begin(), input.end(), v.begin());
+		auto sort_time = time_call([&v, &scratch, limit]() {
+			tests::inplace_merge_sort(v.begin(), v.end(), scratch.data(), limit);
+		});
+		assert(std::is_sorted(v.begin(), v.end()));
+		report("inplace_merge_sort", limit, sort_time);
+	}
+
+	std::copy(input.begin(), input.end(), v.begin());
+	auto buffered_time = time_call([&v]() { tests::merge_sort(v.begin(), v.end()); });
+	assert(std::is_sorted(v.begin(), v.end()));
+	report("merge_sort", v.size(), buffered_time);
+}
+
+// times full sorts with each leaf size to find where networks stop paying off
+void sort_network_benchmark() {
+	int size = 2'000'000;
+
+#ifdef _DEBUG
+	size /= 1000;
+#endif
+
+	std::vector<int> input;
+	for (int i = 0; i < size; ++i)
+		input.push_back(rand());
+
+	const std::size_t leaf_sizes[] = { 1, 4, 8, 12, 16, 20, 24, 32 };
+	for (auto leaf_size : leaf_sizes) {
+		auto v1 = input;
+		auto t1 = time_call([&v1, leaf_size]() {
+			tests::quick_sort_impl(v1.begin(), v1.end(), leaf_size); });
+
+		auto v2 = input;
+		tests::uninitialized_buffer<int> temp(v2.size());
+		auto t2 = time_call([&v2, &temp, leaf_size]() {
+			tests::merge_sort_impl(v2.begin(), v2.end(), leaf_size, temp); });
+
+		assert(std::is_sorted(v1.begin(), v1.end()));
+		assert(std::is_sorted(v2.begin(), v2.end()));
+		std::cout << "leaf " << leaf_size << ": quick_sort " << t1
+			<< "s, merge_sort " << t2 << "s.\n";
+	}
+}
+
+// merging a few keys into many, where galloping skips the long runs, and
+// two random ranges of equal size, where it mustn't cost anything
+void merge_benchmark() {
+	int size = 10'000'000;
+
+#ifdef _DEBUG
+	size /= 1000;
+#endif
+
+	std::vector<int> big, small, other;
+	for (int i = 0; i < size; ++i) {
+		big.push_back(rand());
+		other.push_back(rand());
+	}
+	for (int i = 0; i < 1000; ++i)
+		small.push_back(rand());
+	std::sort(big.begin(), big.end());
+	std::sort(small.begin(), small.end());
+	std::sort(other.begin(), other.end());
+
+	std::vector<int> res1(big.size() + other.size()), res2(res1.size());
+	auto run = [&res1, &res2](const char* name, const std::vector<int>& a, const std::vector<int>& b) {
+		auto std_time = time_call([&a, &b, &res1]() {
+			for (int i = 0; i < 10; ++i)
+				std::merge(a.begin(), a.end(), b.begin(), b.end(), res1.begin());
+		});
+		auto tests_time = time_call([&a, &b, &res2]() {
+			for (int i = 0; i < 10; ++i)
+				tests::merge(a.begin(), a.end(), b.begin(), b.end(), res2.begin());
+		});
+		assert(res1 == res2);
+		std::cout << "merge_benchmark " << name << ": std " << std_time << "s, tests "
+			<< tests_time << "s.\n";
+	};
+
+	run("1K into 10M", small, big);
+	run("10M and 10M", big, other);
+}
+
+enum class search_mode { separate, fused, dense };
+
+// 10M lookups answered by separate lower_bound, upper_bound and binary_search
+// calls, by one cached equal_range_query per key, or by the rank bitvector
+void search_benchmark(search_mode mode) {
+	std::vector<int> v;
+	int vals_count = 100'000;
+	int queries_count = 10'000'000;
+
+#ifdef _DEBUG
+	vals_count /= 1000;
+	queries_count /= 1000;
+#endif
+
+	for (int i = 0; i < vals_count; ++i)
+		v.push_back(rand() % queries_count);
+	std::sort(v.begin(), v.end());
+
+	std::vector<int> queries;
+	for (int i = 0; i < queries_count; ++i)
+		queries.push_back(rand() % queries_count);
+
+	// positions and hits folded into a checksum instead of stored per query
+	long long std_sum = 0, tests_sum = 0;
+	auto std_time = time_call([&queries, &v, &std_sum]() {
+		for (int x : queries) {
+			std_sum += std::lower_bound(v.begin(), v.end(), x) - v.begin();
+			std_sum += std::upper_bound(v.begin(), v.end(), x) - v.begin();
+			std_sum += std::binary_search(v.begin(), v.end(), x);
+		}
+	});
+
+	tests::search_cache<std::vector<int>::iterator> cache(v.begin(), v.end());
+	tests::dense_int_index<std::vector<int>::iterator> index(v.begin(), v.end());
+	auto tests_time = time_call([&queries, &v, &cache, &index, &tests_sum, mode]() {
+		for (int x : queries) {
+			if (mode == search_mode::fused) {
+				auto res = cache.equal_range_query(x);
+				tests_sum += (res.lower - v.begin()) + (res.upper - v.begin()) + res.found;
+			}
+			else if (mode == search_mode::dense) {
+				auto res = index.equal_range_query(x);
+				tests_sum += (res.lower - v.begin()) + (res.upper - v.begin()) + res.found;
+			}
+			else {
+				tests_sum += tests::lower_bound(v.begin(), v.end(), x) - v.begin();
+				tests_sum += tests::upper_bound(v.begin(), v.end(), x) - v.begin();
+				tests_sum += tests::binary_search(v.begin(), v.end(), x);
+			}
+		}
+	});
+
+	const char* names[] = { "", " (fused)", " (dense)" };
+	assert(std_sum == tests_sum);
+	std::cout << "search_benchmark" << names[static_cast<int>(mode)] << ": std "
+		<< std_time << "s, tests " << tests_time << "s.\n";
+}
+
+// the same tests:: algorithms over a node per element and a node per block;
+// returns a checksum of the results
+template<typename C>
+long long unrolled_list_benchmark(const char* name, const std::vector<int>& input) {
+	C c(input.begin(), input.end());
+
+	long long sum = 0;
+	auto for_each_time = time_call([&c, &sum]() {
+		for (int i = 0; i < 10; ++i)
+			tests::for_each(c.begin(), c.end(), [&sum](int x) { sum += x; });
+	});
+
+	long long odd = 0;
+	auto count_if_time = time_call([&c, &odd]() {
+		for (int i = 0; i < 10; ++i)
+			odd += tests::count_if(c.begin(), c.end(), [](int x) { return x % 2; });
+	});
+
+	auto sort_time = time_call([&c]() { tests::merge_sort(c.begin(), c.end()); });
+	assert(std::is_sorted(c.begin(), c.end()));
+
+	long long pos = 0;
+	auto search_time = time_call([&c, &pos]() {
+		for (int x = 0; x < 100; ++x)
+			pos += tests::distance(c.begin(), tests::lower_bound(c.begin(), c.end(), x * 320));
+	});
+
+	std::cout << name << ": for_each " << for_each_time << "s, count_if " << count_if_time
+		<< "s, merge_sort " << sort_time << "s, lower_bound " << search_time
+		<< "s.\n";
+	return sum + odd + pos;
+}
+
+void unrolled_list_benchmark() {
+	int size = 1'000'000;
+
+#ifdef _DEBUG
+	size /= 1000;
+#endif
+
+	std::vector<int> input;
+	for (int i = 0; i < size; ++i)
+		input.push_back(rand());
+
+	auto list_sum = unrolled_list_benchmark<std::list<int>>("std::list", input);
+	auto unrolled_sum = unrolled_list_benchmark<tests::unrolled_list<int>>(
+		"tests::unrolled_list", input);
+	assert(list_sum == unrolled_sum);
+}
+
+// heavy elements sorted by their int key: whole-object sorts against
+// sorting compact (key, index) pairs and moving every element once
+void indirect_sort_benchmark() {
+	int size = 1'000'000;
+
+#ifdef _DEBUG
+	size /= 1000;
+#endif
+
+	std::vector<test_type> input;
+	for (int i = 0; i < size; ++i)
+		input.push_back(test_type(rand()));
+
+	auto v1 = input;
+	auto std_time = time_call([&v1]() {
+		std::sort(v1.begin(), v1.end(),
+			[](const test_type& a, const test_type& b) { return a.d < b.d; });
+	});
+
+	auto v2 = input;
+	auto projected_time = time_call([&v2]() {
+		tests::quick_sort(v2.begin(), v2.end(), std::less<int>(), &test_type::d);
+	});
+
+	auto v3 = input;
+	auto indirect_time = time_call([&v3]() {
+		tests::indirect_sort(v3.begin(), v3.end(), &test_type::d);
+	});
+
+	auto by_d = [](const test_type& a, const test_type& b) { return a.d < b.d; };
+	assert(std::is_sorted(v2.begin(), v2.end(), by_d));
+	assert(std::is_sorted(v3.begin(), v3.end(), by_d));
+	std::cout << "indirect_sort_benchmark: std::sort " << std_time << "s, quick_sort "
+		<< projected_time << "s, indirect_sort " << indirect_time << "s.\n";
+}
+
+// a transform, filter and sum chain run stage by stage through temporary
+// vectors against the same chain fused into one pipeline pass
+template<typename C>
+void range_pipeline_benchmark(const char* name, const std::vector<int>& input) {
+	C c(input.begin(), input.end());
+	auto scale = [](int x) { return x * 3 + 1; };
+	auto keep = [](int x) { return (x & 4) == 0; };
+	const int runs = 20;
+
+	long long materialized_sum = 0;
+	auto materialized_time = time_call([&c, &materialized_sum, scale, keep]() {
+		for (int i = 0; i < runs; ++i) {
+			std::vector<int> scaled(c.size());
+			std::transform(c.begin(), c.end(), scaled.begin(), scale);
+			std::vector<int> kept;
+			std::copy_if(scaled.begin(), scaled.end(), std::back_inserter(kept), keep);
+			materialized_sum += std::accumulate(kept.begin(), kept.end(), 0LL);
+		}
+	});
+
+	long long fused_sum = 0;
+	auto fused_time = time_call([&c, &fused_sum, scale, keep]() {
+		for (int i = 0; i < runs; ++i)
+			fused_sum += tests::make_pipeline(c).transform(scale).filter(keep).reduce(0LL);
+	});
+
+	assert(materialized_sum == fused_sum);
+	std::cout << "range_pipeline_benchmark " << name << ": materialized "
+		<< materialized_time << "s, fused " << fused_time << "s.\n";
+}
+
+void range_pipeline_benchmark() {
+	int size = 4'000'000;
+
+#ifdef _DEBUG
+	size /= 1000;
+#endif
+
+	std::vector<int> input;
+	for (int i = 0; i < size; ++i)
+		input.push_back(rand() % 1000);
+
+	range_pipeline_benchmark<std::vector<int>>("std::vector", input);
+	range_pipeline_benchmark<tests::unrolled_list<int>>("tests::unrolled_list", input);
+}
+
+// read throughput of tests::sorted_index as readers and write rate grow
+void sorted_index_benchmark() {
+	int vals_count = 100'000;
+	int duration_ms = 200;
+
+#ifdef _DEBUG
+	vals_count /= 1000;
+	duration_ms /= 10;
+#endif
+
+	std::vector<int> v;
+	for (int i = 0; i < vals_count; ++i)
+		v.push_back(rand());
+
+	const int writes_per_ms[] = { 0, 10, 100 };
+	const int readers_counts[] = { 1, 2, 4, 8 };
+	for (auto writes : writes_per_ms) {
+		for (auto readers_count : readers_counts) {
+			tests::sorted_index<int> index(v.begin(), v.end(), 1024);
+			std::atomic<bool> done(false);
+			std::atomic<long long> reads(0);
+
+			std::vector<std::thread> threads;
+			for (int i = 0; i < readers_count; ++i) {
+				threads.emplace_back([&index, &done, &reads, i]() {
+					tests::sorted_index<int>::reader r(index);
+					std::minstd_rand gen(i);
+					long long local_reads = 0;
+					for (; !done.load(std::memory_order_relaxed); ++local_reads)
+						r.contains(static_cast<int>(gen()));
+					reads += local_reads;
+				});
+			}
+
+			threads.emplace_back([&index, &done, writes]() {
+				std::minstd_rand gen(1000);
+				while (!done.load(std::memory_order_relaxed)) {
+					for (int i = 0; i < writes; ++i)
+						index.insert(static_cast<int>(gen()));
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+			done.store(true);
+			for (auto& t : threads)
+				t.join();
+
+			std::cout << "sorted_index readers " << readers_count << ", writes/ms "
+				<< writes << ": " << reads.load() * 1000 / duration_ms << " reads/s.\n";
+		}
+	}
 }
 
 int main() {
+	inplace_merge_benchmark();
 	auto t = time_call(run_tests);
 	std::cout << "Time: " << t << "\n";
+	sort_network_benchmark();
+	merge_benchmark();
+	search_benchmark(search_mode::separate);
+	search_benchmark(search_mode::fused);
+	search_benchmark(search_mode::dense);
+	sorted_index_benchmark();
+	unrolled_list_benchmark();
+	indirect_sort_benchmark();
+	range_pipeline_benchmark();
 	std::vector<int> v;
 	std::stable_partition(v.begin(), v.end(), []() {return true; });
 }
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <vector>
+#include <list>
 #include <algorithm>
 
 using namespace std;
@@ -65,11 +66,12 @@ namespace tests {
 		return res;
 	}
 
-	template<typename InputIt, typename UnaryOperation>
-	void transform(InputIt in_begin, InputIt in_end, InputIt out_begin, 
+	template<typename InputIt, typename OutputIt, typename UnaryOperation>
+	OutputIt transform(InputIt in_begin, InputIt in_end, OutputIt out_begin,
 		UnaryOperation unary_op) {
 		for (auto it = in_begin; it != in_end; ++it, ++out_begin)
 			*out_begin = unary_op(*it);
+		return out_begin;
 	}
 
 	template<typename T, size_t N>
@@ -135,6 +137,11 @@ void tests_algorithm()
 
 	assert(v1 == v2);
 
+	// the output may be another container
+	std::list<int> l(v2.size());
+	assert(tests::transform(v2.begin(), v2.end(), l.begin(), square) == l.end());
+	assert(std::equal(l.begin(), l.end(), v1.begin(), [&square](int a, int b) { return a == square(b); }));
+
 	int a[10];
 
 	assert(std::begin(a) == tests::begin(a));
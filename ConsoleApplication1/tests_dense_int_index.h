@@ -0,0 +1,240 @@
+#pragma once
+
+#include "Header.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// rank bitvector index over dense integer keys
+namespace tests {
+	// bit-twiddling count, for CPUs without a popcount instruction
+	inline std::size_t popcount_portable(std::uint64_t x) {
+		x -= (x >> 1) & 0x5555555555555555ULL;
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return static_cast<std::size_t>((x * 0x0101010101010101ULL) >> 56);
+	}
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	// MSVC emits POPCNT for __popcnt without checking for it, so CPUID is
+	// asked once (leaf 1, ECX bit 23)
+	inline bool has_popcnt() {
+		static const bool supported = [] {
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 23)) != 0;
+		}();
+		return supported;
+	}
+#endif
+
+	inline std::size_t popcount(std::uint64_t x) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		if (!tests::has_popcnt())
+			return tests::popcount_portable(x);
+#if defined(_M_X64)
+		return static_cast<std::size_t>(__popcnt64(x));
+#else
+		return __popcnt(static_cast<std::uint32_t>(x)) + __popcnt(static_cast<std::uint32_t>(x >> 32));
+#endif
+#elif defined(_MSC_VER)
+		return tests::popcount_portable(x);
+#else
+		return static_cast<std::size_t>(__builtin_popcountll(x));
+#endif
+	}
+
+	// Bitvector answering rank(i), the ones in [0, i), in O(1): a running
+	// count every 512 bits, so the rest is at most 8 popcounts within one
+	// cache line of words.
+	class rank_bitvector {
+	public:
+		static constexpr std::size_t block_words = 8;
+
+		rank_bitvector() : rank_bitvector(0) {}
+
+		// one spare word, so rank(bits) stays in bounds
+		explicit rank_bitvector(std::size_t bits) : words(bits / 64 + 1, 0) {}
+
+		void set(std::size_t i) {
+			words[i / 64] |= std::uint64_t(1) << (i % 64);
+		}
+
+		bool test(std::size_t i) const {
+			return (words[i / 64] >> (i % 64)) & 1;
+		}
+
+		// must be called after the last set and before the first rank
+		void build() {
+			blocks.clear();
+			std::size_t ones = 0;
+			for (std::size_t w = 0; w < words.size(); ++w) {
+				if (w % block_words == 0)
+					blocks.push_back(ones);
+				ones += tests::popcount(words[w]);
+			}
+		}
+
+		std::size_t rank(std::size_t i) const {
+			std::size_t w = i / 64;
+			std::size_t ones = blocks[w / block_words];
+			for (std::size_t k = w - w % block_words; k < w; ++k)
+				ones += tests::popcount(words[k]);
+			return ones + tests::popcount(words[w] & ((std::uint64_t(1) << (i % 64)) - 1));
+		}
+
+	private:
+		std::vector<std::uint64_t> words;
+		std::vector<std::size_t> blocks;
+	};
+
+	// Answers lower_bound, upper_bound and binary_search over a sorted range
+	// of integers in O(1). Bit v - min is set for every value v present, so
+	// rank gives the number of distinct values below a key. Duplicates are
+	// added back through a sidecar sized by the duplicated values only: a
+	// bitvector over distinct values flagging them, and the prefix sums of
+	// their extra copies. Costs (max - min) / 8 bytes, so it suits dense key
+	// domains; a range spanning more than max_bits_per_key values per element
+	// is not indexed and is binary searched instead.
+	template<typename RanIt>
+	class dense_int_index {
+	public:
+		using value_type = typename tests::iterator_traits<RanIt>::value_type;
+		using difference_type = typename tests::iterator_traits<RanIt>::difference_type;
+
+		static_assert(std::is_integral<value_type>::value, "dense_int_index needs integer keys");
+
+		static constexpr std::size_t max_bits_per_key = 256;
+
+		dense_int_index(RanIt _first, RanIt _last) :
+			first(_first),
+			last(_last),
+			min_key(),
+			max_key(),
+			extra_before(1, 0),
+			dense(true) {
+			if (first == last)
+				return;
+
+			min_key = *first;
+			max_key = *(last - 1);
+			// checked before sizing the bitvector: a full 64-bit range has no
+			// span + 1, and a few keys across 32 bits would take 512 MB
+			auto span = offset(max_key);
+			auto n = static_cast<std::size_t>(last - first);
+			if (span == std::numeric_limits<std::size_t>::max() || span / max_bits_per_key > n) {
+				dense = false;
+				return;
+			}
+			values = tests::rank_bitvector(span + 1);
+
+			std::vector<std::size_t> duplicated;
+			std::size_t distinct = 0;
+			for (auto it = first; it != last; ++distinct) {
+				auto run = it;
+				while (++run != last && *run == *it);
+
+				values.set(offset(*it));
+				if (run - it > 1) {
+					duplicated.push_back(distinct);
+					extra_before.push_back(extra_before.back() + (run - it - 1));
+				}
+				it = run;
+			}
+			values.build();
+
+			duplicates = tests::rank_bitvector(distinct);
+			for (auto r : duplicated)
+				duplicates.set(r);
+			duplicates.build();
+		}
+
+		// false if the keys were too sparse to index
+		bool is_dense() const {
+			return dense;
+		}
+
+		RanIt lower_bound(value_type key) const {
+			if (!dense)
+				return tests::lower_bound(first, last, key);
+			if (first == last || key <= min_key)
+				return first;
+			if (key > max_key)
+				return last;
+			return first + elements_below(offset(key));
+		}
+
+		RanIt upper_bound(value_type key) const {
+			if (!dense)
+				return tests::upper_bound(first, last, key);
+			if (first == last || key < min_key)
+				return first;
+			if (key >= max_key)
+				return last;
+			return first + elements_below(offset(key) + 1);
+		}
+
+		bool binary_search(value_type key) const {
+			if (!dense)
+				return tests::binary_search(first, last, key);
+			return first != last && min_key <= key && key <= max_key && values.test(offset(key));
+		}
+
+		// one rank per bitvector: the key's own bits give its count
+		search_result<RanIt> equal_range_query(value_type key) const {
+			if (!dense)
+				return tests::equal_range_query(first, last, key);
+			if (first == last || key < min_key)
+				return{ first, first, false, 0 };
+			if (key > max_key)
+				return{ last, last, false, 0 };
+
+			auto v = offset(key);
+			auto distinct = values.rank(v);
+			auto dup = duplicates.rank(distinct);
+			RanIt lower = first + static_cast<difference_type>(distinct + extra_before[dup]);
+			if (!values.test(v))
+				return{ lower, lower, false, 0 };
+
+			difference_type count = 1;
+			if (duplicates.test(distinct))
+				count += static_cast<difference_type>(extra_before[dup + 1] - extra_before[dup]);
+			return{ lower, lower + count, true, count };
+		}
+
+	private:
+		// computed in the unsigned type, so it can't overflow for min <= key;
+		// a span wider than size_t saturates, which the constructor rejects
+		std::size_t offset(value_type key) const {
+			using unsigned_type = std::make_unsigned_t<value_type>;
+			auto diff = static_cast<unsigned_type>(
+				static_cast<unsigned_type>(key) - static_cast<unsigned_type>(min_key));
+			if (diff > std::numeric_limits<std::size_t>::max())
+				return std::numeric_limits<std::size_t>::max();
+			return static_cast<std::size_t>(diff);
+		}
+
+		// elements with key - min < v: distinct values below v plus the extra
+		// copies of the duplicated ones among them
+		difference_type elements_below(std::size_t v) const {
+			auto distinct = values.rank(v);
+			return static_cast<difference_type>(distinct + extra_before[duplicates.rank(distinct)]);
+		}
+
+		RanIt first;
+		RanIt last;
+		value_type min_key;
+		value_type max_key;
+		tests::rank_bitvector values;
+		tests::rank_bitvector duplicates;
+		std::vector<std::size_t> extra_before;
+		bool dense;
+	};
+}
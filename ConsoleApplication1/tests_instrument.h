@@ -0,0 +1,311 @@
+#pragma once
+
+#include "std_.h"
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+// operation counting, to compare algorithm cost without timer noise
+namespace tests {
+	namespace instrument {
+		struct counters {
+			std::size_t comparisons = 0;
+			std::size_t copies = 0;
+			std::size_t moves = 0;
+			std::size_t swaps = 0;
+			std::size_t allocations = 0;
+			std::size_t increments = 0;
+			std::size_t decrements = 0;
+			std::size_t dereferences = 0;
+
+			counters& operator+=(const counters& o) {
+				comparisons += o.comparisons;
+				copies += o.copies;
+				moves += o.moves;
+				swaps += o.swaps;
+				allocations += o.allocations;
+				increments += o.increments;
+				decrements += o.decrements;
+				dereferences += o.dereferences;
+				return *this;
+			}
+		};
+
+		inline counters operator-(counters a, const counters& b) {
+			a.comparisons -= b.comparisons;
+			a.copies -= b.copies;
+			a.moves -= b.moves;
+			a.swaps -= b.swaps;
+			a.allocations -= b.allocations;
+			a.increments -= b.increments;
+			a.decrements -= b.decrements;
+			a.dereferences -= b.dereferences;
+			return a;
+		}
+
+		inline std::ostream& operator<<(std::ostream& os, const counters& c) {
+			return os << "cmp " << c.comparisons << ", copy " << c.copies
+				<< ", move " << c.moves << ", swap " << c.swaps
+				<< ", alloc " << c.allocations << ", ++ " << c.increments
+				<< ", -- " << c.decrements << ", * " << c.dereferences;
+		}
+
+		// per thread, so tests running as concurrent tasks don't mix counts
+		inline counters& current() {
+			static thread_local counters c;
+			return c;
+		}
+
+		struct recorder {
+			counters& into;
+			counters before;
+			explicit recorder(counters& _into) : into(_into), before(current()) {}
+			~recorder() {
+				into += current() - before;
+			}
+		};
+
+		// runs f, adding the operations it performed on this thread to into
+		template<typename Function>
+		auto record(counters& into, Function f) {
+			recorder r(into);
+			return f();
+		}
+
+		// counts calls to a comparator or predicate as comparisons
+		template<typename Compare>
+		struct counting_compare {
+			Compare comp;
+
+			counting_compare(Compare _comp = Compare{}) : comp(_comp) {}
+
+			template<typename... Args>
+			bool operator()(Args&&... args) const {
+				++current().comparisons;
+				return static_cast<bool>(comp(std::forward<Args>(args)...));
+			}
+		};
+
+		template<typename Compare>
+		counting_compare<Compare> make_counting_compare(Compare comp) {
+			return counting_compare<Compare>(comp);
+		}
+
+		// iterator adaptor counting traversal and element access; random access
+		// operations are only available when It supports them
+		template<typename It>
+		class counting_iterator {
+		public:
+			using iterator_category = typename tests::iterator_traits<It>::iterator_category;
+			using value_type = typename tests::iterator_traits<It>::value_type;
+			using difference_type = typename tests::iterator_traits<It>::difference_type;
+			using pointer = typename tests::iterator_traits<It>::pointer;
+			using reference = typename tests::iterator_traits<It>::reference;
+
+			counting_iterator() = default;
+			explicit counting_iterator(It _it) : it(_it) {}
+
+			It base() const { return it; }
+
+			reference operator*() const {
+				++current().dereferences;
+				return *it;
+			}
+
+			auto operator->() const {
+				++current().dereferences;
+				return std::addressof(*it);
+			}
+
+			reference operator[](difference_type n) const {
+				++current().dereferences;
+				return it[n];
+			}
+
+			counting_iterator& operator++() {
+				++current().increments;
+				++it;
+				return *this;
+			}
+
+			counting_iterator operator++(int) {
+				auto old = *this;
+				++*this;
+				return old;
+			}
+
+			counting_iterator& operator--() {
+				++current().decrements;
+				--it;
+				return *this;
+			}
+
+			counting_iterator operator--(int) {
+				auto old = *this;
+				--*this;
+				return old;
+			}
+
+			counting_iterator& operator+=(difference_type n) {
+				++current().increments;
+				it += n;
+				return *this;
+			}
+
+			counting_iterator& operator-=(difference_type n) {
+				++current().decrements;
+				it -= n;
+				return *this;
+			}
+
+			friend counting_iterator operator+(counting_iterator a, difference_type n) {
+				return a += n;
+			}
+
+			friend counting_iterator operator+(difference_type n, counting_iterator a) {
+				return a += n;
+			}
+
+			friend counting_iterator operator-(counting_iterator a, difference_type n) {
+				return a -= n;
+			}
+
+			friend difference_type operator-(const counting_iterator& a,
+				const counting_iterator& b) {
+				return a.it - b.it;
+			}
+
+			friend bool operator==(const counting_iterator& a, const counting_iterator& b) {
+				return a.it == b.it;
+			}
+
+			friend bool operator!=(const counting_iterator& a, const counting_iterator& b) {
+				return a.it != b.it;
+			}
+
+			friend bool operator<(const counting_iterator& a, const counting_iterator& b) {
+				return a.it < b.it;
+			}
+
+			friend bool operator>(const counting_iterator& a, const counting_iterator& b) {
+				return b.it < a.it;
+			}
+
+			friend bool operator<=(const counting_iterator& a, const counting_iterator& b) {
+				return !(b.it < a.it);
+			}
+
+			friend bool operator>=(const counting_iterator& a, const counting_iterator& b) {
+				return !(a.it < b.it);
+			}
+
+		private:
+			It it;
+		};
+
+		template<typename It>
+		counting_iterator<It> make_counting_iterator(It it) {
+			return counting_iterator<It>(it);
+		}
+
+		// value held on the heap, like a string, so copies cost an allocation
+		// and moves don't; operator< counts comparisons itself
+		template<typename T>
+		class tracked {
+		public:
+			explicit tracked(T value) : payload(new T(std::move(value))) {
+				++current().allocations;
+			}
+
+			tracked(const tracked& o) : payload(new T(*o.payload)) {
+				++current().copies;
+				++current().allocations;
+			}
+
+			tracked(tracked&& o) noexcept : payload(std::move(o.payload)) {
+				++current().moves;
+			}
+
+			tracked& operator=(const tracked& o) {
+				++current().copies;
+				++current().allocations;
+				payload.reset(new T(*o.payload));
+				return *this;
+			}
+
+			tracked& operator=(tracked&& o) noexcept {
+				++current().moves;
+				payload = std::move(o.payload);
+				return *this;
+			}
+
+			friend void swap(tracked& a, tracked& b) noexcept {
+				++current().swaps;
+				a.payload.swap(b.payload);
+			}
+
+			const T& value() const { return *payload; }
+
+			tracked& operator++() {
+				++*payload;
+				return *this;
+			}
+
+			friend bool operator<(const tracked& a, const tracked& b) {
+				++current().comparisons;
+				return *a.payload < *b.payload;
+			}
+
+			friend bool operator==(const tracked& a, const tracked& b) {
+				++current().comparisons;
+				return *a.payload == *b.payload;
+			}
+
+			friend auto operator%(const tracked& a, const T& b) {
+				return *a.payload % b;
+			}
+
+		private:
+			std::unique_ptr<T> payload;
+		};
+
+		// Allocator counting allocations of Counted, e.g. the characters of a
+		// std::basic_string. Rebound copies don't count, since debug standard
+		// libraries allocate iterator bookkeeping through them.
+		template<typename T, typename Counted = T>
+		struct counting_allocator {
+			using value_type = T;
+
+			template<typename U>
+			struct rebind {
+				using other = counting_allocator<U, Counted>;
+			};
+
+			counting_allocator() = default;
+
+			template<typename U>
+			counting_allocator(const counting_allocator<U, Counted>&) {}
+
+			T* allocate(std::size_t n) {
+				if (std::is_same<T, Counted>::value)
+					++current().allocations;
+				return std::allocator<T>().allocate(n);
+			}
+
+			void deallocate(T* p, std::size_t n) {
+				std::allocator<T>().deallocate(p, n);
+			}
+
+			friend bool operator==(const counting_allocator&, const counting_allocator&) {
+				return true;
+			}
+
+			friend bool operator!=(const counting_allocator&, const counting_allocator&) {
+				return false;
+			}
+		};
+	}
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "Header.h"
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// lazy range pipelines
+namespace tests {
+	// Adaptors compose push-style: each one wraps the consumer downstream of
+	// it, and a terminal operation drives one loop over the source that
+	// hands every element through the whole chain. transform, filter, take
+	// and count over a vector compile to a single pass with no temporaries.
+	// Consumers return false to stop the loop early; only take ever does, so
+	// other chains inline to a loop without an exit the compiler can't
+	// vectorize.
+
+	template<typename F, typename Sink>
+	struct transform_sink {
+		F f;
+		Sink next;
+
+		template<typename T>
+		bool operator()(T&& x) {
+			return next(f(std::forward<T>(x)));
+		}
+	};
+
+	template<typename Predicate, typename Sink>
+	struct filter_sink {
+		Predicate pred;
+		Sink next;
+
+		template<typename T>
+		bool operator()(T&& x) {
+			return pred(x) ? next(std::forward<T>(x)) : true;
+		}
+	};
+
+	// left is never 0 on entry: a pipeline with a take(0) is not run
+	template<typename Sink>
+	struct take_sink {
+		std::size_t left;
+		Sink next;
+
+		template<typename T>
+		bool operator()(T&& x) {
+			--left;
+			return next(std::forward<T>(x)) && left != 0;
+		}
+	};
+
+	// passes (index, element) pairs; the element stays a reference when the
+	// stage before hands one over
+	template<typename Sink>
+	struct enumerate_sink {
+		std::size_t index;
+		Sink next;
+
+		template<typename T>
+		bool operator()(T&& x) {
+			return next(std::pair<std::size_t, T>(index++, std::forward<T>(x)));
+		}
+	};
+
+	// Stages describe the chain until a terminal operation binds its
+	// consumer. empty() is true when no element can get through, so the
+	// source need not be read at all.
+	struct source_stage {
+		template<typename Sink>
+		Sink operator()(Sink next) const {
+			return next;
+		}
+
+		bool empty() const {
+			return false;
+		}
+	};
+
+	template<typename Stage, typename F>
+	struct transform_stage {
+		Stage stage;
+		F f;
+
+		template<typename Sink>
+		auto operator()(Sink next) const {
+			return stage(transform_sink<F, Sink>{ f, next });
+		}
+
+		bool empty() const {
+			return stage.empty();
+		}
+	};
+
+	template<typename Stage, typename Predicate>
+	struct filter_stage {
+		Stage stage;
+		Predicate pred;
+
+		template<typename Sink>
+		auto operator()(Sink next) const {
+			return stage(filter_sink<Predicate, Sink>{ pred, next });
+		}
+
+		bool empty() const {
+			return stage.empty();
+		}
+	};
+
+	template<typename Stage>
+	struct take_stage {
+		Stage stage;
+		std::size_t count;
+
+		template<typename Sink>
+		auto operator()(Sink next) const {
+			return stage(take_sink<Sink>{ count, next });
+		}
+
+		bool empty() const {
+			return count == 0 || stage.empty();
+		}
+	};
+
+	template<typename Stage>
+	struct enumerate_stage {
+		Stage stage;
+
+		template<typename Sink>
+		auto operator()(Sink next) const {
+			return stage(enumerate_sink<Sink>{ 0, next });
+		}
+
+		bool empty() const {
+			return stage.empty();
+		}
+	};
+
+	template<typename InputIt, typename Sink>
+	bool drive_impl(InputIt first, InputIt last, Sink& sink, std::false_type) {
+		for (; first != last; ++first)
+			if (!sink(*first))
+				return false;
+		return true;
+	}
+
+	// a pointer loop per block; blocks after a stop are skipped unvisited
+	template<typename SegIt, typename Sink>
+	bool drive_impl(SegIt first, SegIt last, Sink& sink, std::true_type) {
+		bool more = true;
+		tests::for_each_segment(first, last, [&sink, &more](auto local_first, auto local_last) {
+			if (more)
+				more = tests::drive_impl(local_first, local_last, sink, std::false_type{});
+		});
+		return more;
+	}
+
+	// A lazy view of [first, last) through a chain of adaptors. Adaptors
+	// return a new pipeline and do no work; the terminal operations run it.
+	// Adaptors and predicates are copied into the pipeline, the source is
+	// not, so it must outlive the terminal call.
+	template<typename InputIt, typename Stage = source_stage>
+	class range_pipeline {
+	public:
+		range_pipeline(InputIt _first, InputIt _last, Stage _stage = Stage()) :
+			first(_first), last(_last), stage(_stage) {
+		}
+
+		// adaptors
+
+		template<typename F>
+		auto transform(F f) const {
+			using next_stage = transform_stage<Stage, F>;
+			return range_pipeline<InputIt, next_stage>(first, last, next_stage{ stage, f });
+		}
+
+		template<typename Predicate>
+		auto filter(Predicate pred) const {
+			using next_stage = filter_stage<Stage, Predicate>;
+			return range_pipeline<InputIt, next_stage>(first, last, next_stage{ stage, pred });
+		}
+
+		// the first n elements reaching this stage; the source is read no
+		// further, and not at all for take(0)
+		auto take(std::size_t n) const {
+			using next_stage = take_stage<Stage>;
+			return range_pipeline<InputIt, next_stage>(first, last, next_stage{ stage, n });
+		}
+
+		auto enumerate() const {
+			using next_stage = enumerate_stage<Stage>;
+			return range_pipeline<InputIt, next_stage>(first, last, next_stage{ stage });
+		}
+
+		// terminal operations
+
+		template<typename T, typename BinaryOperation>
+		T reduce(T init, BinaryOperation op) const {
+			run([&init, &op](auto&& x) {
+				init = op(std::move(init), std::forward<decltype(x)>(x));
+				return true;
+			});
+			return init;
+		}
+
+		template<typename T>
+		T reduce(T init) const {
+			return reduce(init, std::plus<>());
+		}
+
+		template<typename T, typename BinaryOperation, typename UnaryOperation>
+		T transform_reduce(T init, BinaryOperation reduce_op, UnaryOperation transform_op) const {
+			return transform(transform_op).reduce(init, reduce_op);
+		}
+
+		std::size_t count() const {
+			std::size_t n = 0;
+			run([&n](auto&&) {
+				++n;
+				return true;
+			});
+			return n;
+		}
+
+		template<typename OutputIt>
+		OutputIt copy_to(OutputIt out) const {
+			run([&out](auto&& x) {
+				*out = std::forward<decltype(x)>(x);
+				++out;
+				return true;
+			});
+			return out;
+		}
+
+	private:
+		template<typename Sink>
+		void run(Sink consume) const {
+			if (stage.empty())
+				return;
+			auto sink = stage(consume);
+			tests::drive_impl(first, last, sink, tests::is_segmented_iterator<InputIt>{});
+		}
+
+		InputIt first;
+		InputIt last;
+		Stage stage;
+	};
+
+	template<typename InputIt>
+	range_pipeline<InputIt> make_pipeline(InputIt first, InputIt last) {
+		return range_pipeline<InputIt>(first, last);
+	}
+
+	template<typename Container>
+	auto make_pipeline(Container& c) {
+		return tests::make_pipeline(c.begin(), c.end());
+	}
+}
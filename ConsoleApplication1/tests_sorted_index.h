@@ -0,0 +1,225 @@
+#pragma once
+
+#include "Header.h"
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// concurrent read-mostly sorted index
+namespace tests {
+	// epoch-based reclamation: readers announce the epoch they entered in, and
+	// an object retired in epoch e is freed once every reader has left e
+	class epoch_manager {
+	public:
+		static constexpr std::size_t max_readers = 64;
+		static constexpr std::uint64_t idle = std::numeric_limits<std::uint64_t>::max();
+
+		epoch_manager() : epoch(0) {
+			for (auto& s : slots) {
+				s.epoch.store(idle);
+				s.taken.store(false);
+			}
+		}
+
+		std::size_t acquire_slot() {
+			for (std::size_t i = 0; i < max_readers; ++i) {
+				bool expected = false;
+				if (slots[i].taken.compare_exchange_strong(expected, true))
+					return i;
+			}
+			throw std::runtime_error("epoch_manager: too many readers");
+		}
+
+		void release_slot(std::size_t i) {
+			slots[i].taken.store(false);
+		}
+
+		// sequentially consistent, so the slot is visible before the reader
+		// loads anything the writer may retire
+		void enter(std::size_t i) {
+			slots[i].epoch.store(epoch.load());
+		}
+
+		void leave(std::size_t i) {
+			slots[i].epoch.store(idle);
+		}
+
+		// closes the current epoch and returns it, the epoch to retire under
+		std::uint64_t advance() {
+			return epoch.fetch_add(1);
+		}
+
+		// the oldest epoch a reader may still be in
+		std::uint64_t oldest_active() const {
+			auto oldest = idle;
+			for (auto& s : slots) {
+				auto e = s.epoch.load();
+				if (e < oldest)
+					oldest = e;
+			}
+			return oldest;
+		}
+
+	private:
+		// one cache line per slot so readers don't false-share
+		struct alignas(64) slot {
+			std::atomic<std::uint64_t> epoch;
+			std::atomic<bool> taken;
+		};
+
+		std::atomic<std::uint64_t> epoch;
+		slot slots[max_readers];
+	};
+
+	// Readers search an immutable sorted snapshot without locks. Inserts
+	// collect in a delta buffer; every batch_size inserts (or on flush) the
+	// writer sorts the delta, merges it with the snapshot into a new one,
+	// publishes that and retires the old snapshot to the epoch_manager.
+	template<typename T>
+	class sorted_index {
+	public:
+		using snapshot = std::vector<T>;
+
+		// registers the calling thread as a reader for its lifetime
+		class reader {
+		public:
+			explicit reader(const sorted_index& _index) :
+				index(&_index),
+				slot(_index.epochs.acquire_slot()) {
+			}
+
+			reader(const reader&) = delete;
+			reader& operator=(const reader&) = delete;
+
+			~reader() {
+				index->epochs.release_slot(slot);
+			}
+
+			// runs f on the current snapshot, which stays alive until f returns
+			template<typename Function>
+			auto read(Function f) const {
+				guard g(index->epochs, slot);
+				return f(*index->current.load());
+			}
+
+			bool contains(const T& key) const {
+				return read([&key](const snapshot& s) {
+					return tests::binary_search(s.begin(), s.end(), key);
+				});
+			}
+
+			std::size_t count(const T& key) const {
+				return read([&key](const snapshot& s) {
+					auto range = tests::equal_range(s.begin(), s.end(), key);
+					return static_cast<std::size_t>(range.second - range.first);
+				});
+			}
+
+			std::size_t size() const {
+				return read([](const snapshot& s) { return s.size(); });
+			}
+
+		private:
+			struct guard {
+				epoch_manager& epochs;
+				std::size_t slot;
+				guard(epoch_manager& _epochs, std::size_t _slot) : epochs(_epochs), slot(_slot) {
+					epochs.enter(slot);
+				}
+				~guard() {
+					epochs.leave(slot);
+				}
+			};
+
+			const sorted_index* index;
+			std::size_t slot;
+		};
+
+		explicit sorted_index(std::size_t _batch_size = 1024) :
+			current(new snapshot()),
+			batch_size(_batch_size) {
+		}
+
+		template<typename InputIt>
+		sorted_index(InputIt first, InputIt last, std::size_t _batch_size = 1024) :
+			current(nullptr),
+			batch_size(_batch_size) {
+			std::unique_ptr<snapshot> initial(new snapshot(first, last));
+			tests::merge_sort(initial->begin(), initial->end(), arena);
+			current.store(initial.release());
+		}
+
+		sorted_index(const sorted_index&) = delete;
+		sorted_index& operator=(const sorted_index&) = delete;
+
+		// no reader may outlive the index
+		~sorted_index() {
+			delete current.load();
+			for (auto& r : retired)
+				delete r.second;
+		}
+
+		// visible to readers after the next flush
+		void insert(const T& key) {
+			std::lock_guard<std::mutex> lock(write_mutex);
+			delta.push_back(key);
+			if (delta.size() >= batch_size)
+				flush_locked();
+		}
+
+		void flush() {
+			std::lock_guard<std::mutex> lock(write_mutex);
+			flush_locked();
+		}
+
+		// retired snapshots still waiting for readers to leave their epoch
+		std::size_t pending_reclaim() const {
+			std::lock_guard<std::mutex> lock(write_mutex);
+			return retired.size();
+		}
+
+	private:
+		void flush_locked() {
+			if (!delta.empty()) {
+				tests::merge_sort(delta.begin(), delta.end(), arena);
+
+				const snapshot* old = current.load();
+				std::unique_ptr<snapshot> next(new snapshot());
+				next->reserve(old->size() + delta.size());
+				tests::merge(old->cbegin(), old->cend(), delta.cbegin(), delta.cend(),
+					std::back_inserter(*next));
+				delta.clear();
+
+				current.store(next.release());
+				retired.emplace_back(epochs.advance(), old);
+			}
+
+			reclaim();
+		}
+
+		void reclaim() {
+			auto oldest = epochs.oldest_active();
+			auto keep = tests::partition(retired.begin(), retired.end(),
+				[oldest](const auto& r) { return r.first >= oldest; });
+			for (auto it = keep; it != retired.end(); ++it)
+				delete it->second;
+			retired.erase(keep, retired.end());
+		}
+
+		std::atomic<const snapshot*> current;
+		mutable epoch_manager epochs;
+
+		// writer state
+		mutable std::mutex write_mutex;
+		std::size_t batch_size;
+		std::vector<T> delta;
+		std::vector<std::pair<std::uint64_t, const snapshot*>> retired;
+		tests::scratch_arena arena;
+	};
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// tasks on a work-stealing thread pool
+namespace tests {
+	// Fixed pool of workers, each with its own deque of jobs. A worker pops
+	// the newest job of its own deque, so nested jobs run depth first on a
+	// warm cache, and steals the oldest job of another deque when its own is
+	// empty. Jobs submitted from outside the pool are dealt round-robin.
+	class scheduler {
+	public:
+		explicit scheduler(std::size_t threads = default_threads()) :
+			pending(0),
+			next_queue(0),
+			helpers(0),
+			stop(false) {
+			for (std::size_t i = 0; i < threads; ++i)
+				queues.push_back(std::make_unique<job_queue>());
+			for (std::size_t i = 0; i < threads; ++i)
+				workers.emplace_back([this, i] { work(i); });
+		}
+
+		scheduler(const scheduler&) = delete;
+		scheduler& operator=(const scheduler&) = delete;
+
+		// runs every job already submitted, then joins the workers
+		~scheduler() {
+			{
+				std::lock_guard<std::mutex> lock(sleep_mutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (auto& t : workers)
+				t.join();
+		}
+
+		static std::size_t default_threads() {
+			auto n = std::thread::hardware_concurrency();
+			return n ? n : 1;
+		}
+
+		static scheduler& default_scheduler() {
+			static scheduler s;
+			return s;
+		}
+
+		std::size_t threads() const {
+			return workers.size();
+		}
+
+		void submit(std::function<void()> job) {
+			auto& self = this_worker();
+			std::size_t i = self.owner == this ? self.index
+				: next_queue.fetch_add(1) % queues.size();
+			// counted first, so pending never drops below the jobs queued
+			{
+				std::lock_guard<std::mutex> lock(sleep_mutex);
+				++pending;
+			}
+			{
+				std::lock_guard<std::mutex> lock(queues[i]->m);
+				queues[i]->jobs.push_back(std::move(job));
+			}
+			wake.notify_one();
+		}
+
+		// true on one of this scheduler's workers
+		bool in_worker() const {
+			return this_worker().owner == this;
+		}
+
+		// runs one waiting job on the calling worker, if there is any
+		bool run_one() {
+			std::function<void()> job;
+			if (!take(this_worker().index, job))
+				return false;
+			job();
+			finished();
+			return true;
+		}
+
+		// Runs jobs on the calling worker until done() holds, sleeping while
+		// none are queued. Every job that finishes wakes it to check again.
+		template<typename Predicate>
+		void run_until(Predicate done) {
+			while (!done()) {
+				if (run_one())
+					continue;
+				std::unique_lock<std::mutex> lock(sleep_mutex);
+				++helpers;
+				wake.wait(lock, [this, &done] { return pending.load() > 0 || done(); });
+				--helpers;
+			}
+		}
+
+	private:
+		struct job_queue {
+			std::mutex m;
+			std::deque<std::function<void()>> jobs;
+		};
+
+		struct worker_id {
+			const scheduler* owner;
+			std::size_t index;
+		};
+
+		static worker_id& this_worker() {
+			thread_local worker_id id{ nullptr, 0 };
+			return id;
+		}
+
+		// the newest job of queue i, or else the oldest of any other queue
+		bool take(std::size_t i, std::function<void()>& job) {
+			{
+				std::lock_guard<std::mutex> lock(queues[i]->m);
+				if (!queues[i]->jobs.empty()) {
+					job = std::move(queues[i]->jobs.back());
+					queues[i]->jobs.pop_back();
+					--pending;
+					return true;
+				}
+			}
+			for (std::size_t k = 1; k < queues.size(); ++k) {
+				auto& victim = *queues[(i + k) % queues.size()];
+				std::lock_guard<std::mutex> lock(victim.m);
+				if (!victim.jobs.empty()) {
+					job = std::move(victim.jobs.front());
+					victim.jobs.pop_front();
+					--pending;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// wakes the workers in run_until, which may be waiting on this job
+		void finished() {
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			if (helpers)
+				wake.notify_all();
+		}
+
+		void work(std::size_t i) {
+			this_worker() = { this, i };
+			for (;;) {
+				std::function<void()> job;
+				if (take(i, job)) {
+					job();
+					finished();
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(sleep_mutex);
+				wake.wait(lock, [this] { return stop || pending.load() > 0; });
+				if (stop && pending.load() == 0)
+					return;
+			}
+		}
+
+		std::vector<std::unique_ptr<job_queue>> queues;
+		std::vector<std::thread> workers;
+		std::mutex sleep_mutex;
+		std::condition_variable wake;
+		std::atomic<std::size_t> pending;
+		std::atomic<std::size_t> next_queue;
+		std::size_t helpers;
+		bool stop;
+	};
+
+	// continuations of a task, started once it finishes
+	struct task_completion {
+		std::mutex m;
+		bool done = false;
+		std::vector<std::function<void()>> continuations;
+
+		void finish() {
+			std::vector<std::function<void()>> ready;
+			{
+				std::lock_guard<std::mutex> lock(m);
+				done = true;
+				ready.swap(continuations);
+			}
+			for (auto& f : ready)
+				f();
+		}
+
+		void on_finish(std::function<void()> f) {
+			{
+				std::lock_guard<std::mutex> lock(m);
+				if (!done) {
+					continuations.push_back(std::move(f));
+					return;
+				}
+			}
+			f();
+		}
+	};
+
+	// Handle to a result computed on a scheduler. get() rethrows whatever
+	// the task threw. Waiting on a worker runs other jobs meanwhile and
+	// sleeps when there are none, so tasks may spawn and wait for tasks of
+	// their own without starving the pool.
+	template<typename T>
+	class task {
+	public:
+		task(scheduler& _pool, std::shared_future<T> _result,
+			std::shared_ptr<task_completion> _completion) :
+			pool(&_pool),
+			result(std::move(_result)),
+			completion(std::move(_completion)) {
+		}
+
+		bool is_done() const {
+			return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		}
+
+		void wait() const {
+			if (!pool->in_worker()) {
+				result.wait();
+				return;
+			}
+			pool->run_until([this] { return is_done(); });
+		}
+
+		decltype(auto) get() const {
+			wait();
+			return result.get();
+		}
+
+		// a task running f(get()), or f() for task<void>, once this one is done
+		template<typename F>
+		auto then(F f) const {
+			return continue_with(f, std::is_void<T>{});
+		}
+
+	private:
+		template<typename F>
+		auto continue_with(F f, std::false_type) const {
+			return start_after([result = result, f]() { return f(result.get()); });
+		}
+
+		template<typename F>
+		auto continue_with(F f, std::true_type) const {
+			return start_after([result = result, f]() { result.get(); return f(); });
+		}
+
+		template<typename F>
+		auto start_after(F f) const {
+			using R = decltype(f());
+			auto job = std::make_shared<std::packaged_task<R()>>(f);
+			auto next_completion = std::make_shared<task_completion>();
+			task<R> next(*pool, job->get_future().share(), next_completion);
+
+			auto s = pool;
+			completion->on_finish([s, job, next_completion] {
+				s->submit([job, next_completion] {
+					(*job)();
+					next_completion->finish();
+				});
+			});
+			return next;
+		}
+
+		scheduler* pool;
+		std::shared_future<T> result;
+		std::shared_ptr<task_completion> completion;
+	};
+
+	template<typename F>
+	auto create_task(scheduler& s, F f) {
+		using R = decltype(f());
+		auto job = std::make_shared<std::packaged_task<R()>>(f);
+		auto completion = std::make_shared<task_completion>();
+		task<R> t(s, job->get_future().share(), completion);
+
+		s.submit([job, completion] {
+			(*job)();
+			completion->finish();
+		});
+		return t;
+	}
+
+	template<typename F>
+	auto create_task(F f) {
+		return tests::create_task(tests::scheduler::default_scheduler(), f);
+	}
+}
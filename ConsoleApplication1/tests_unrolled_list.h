@@ -0,0 +1,391 @@
+#pragma once
+
+#include "Header.h"
+
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// unrolled linked list
+namespace tests {
+	// elements per node: about 512 bytes of them, and never fewer than 4
+	template<typename T>
+	constexpr std::size_t unrolled_list_node_capacity() {
+		return sizeof(T) * 4 < 512 ? 512 / sizeof(T) : 4;
+	}
+
+	template<typename T, std::size_t N>
+	struct unrolled_list_node {
+		unrolled_list_node* prev;
+		unrolled_list_node* next;
+		std::size_t count;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type slots[N];
+
+		T* data() { return reinterpret_cast<T*>(slots); }
+	};
+
+	template<typename T, std::size_t N>
+	class unrolled_list;
+
+	template<typename T, std::size_t N, bool Const>
+	class unrolled_list_iterator {
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = std::conditional_t<Const, const T*, T*>;
+		using reference = std::conditional_t<Const, const T&, T&>;
+
+		unrolled_list_iterator() : node(nullptr), index(0) {}
+
+		template<bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+		unrolled_list_iterator(const unrolled_list_iterator<T, N, OtherConst>& other) :
+			node(other.node), index(other.index) {
+		}
+
+		reference operator*() const { return node->data()[index]; }
+		pointer operator->() const { return node->data() + index; }
+
+		unrolled_list_iterator& operator++() {
+			if (++index == node->count) {
+				node = node->next;
+				index = 0;
+			}
+			return *this;
+		}
+
+		unrolled_list_iterator operator++(int) {
+			auto it = *this;
+			++*this;
+			return it;
+		}
+
+		unrolled_list_iterator& operator--() {
+			if (index == 0) {
+				node = node->prev;
+				index = node->count;
+			}
+			--index;
+			return *this;
+		}
+
+		unrolled_list_iterator operator--(int) {
+			auto it = *this;
+			--*this;
+			return it;
+		}
+
+		friend bool operator==(const unrolled_list_iterator& a, const unrolled_list_iterator& b) {
+			return a.node == b.node && a.index == b.index;
+		}
+
+		friend bool operator!=(const unrolled_list_iterator& a, const unrolled_list_iterator& b) {
+			return !(a == b);
+		}
+
+	private:
+		template<typename, std::size_t, bool> friend class unrolled_list_iterator;
+		template<typename, std::size_t> friend class unrolled_list;
+		friend struct segmented_iterator_traits<unrolled_list_iterator>;
+
+		unrolled_list_iterator(unrolled_list_node<T, N>* _node, std::size_t _index) :
+			node(_node), index(_index) {
+		}
+
+		// index < node->count everywhere but end(), which is the sentinel at 0
+		unrolled_list_node<T, N>* node;
+		std::size_t index;
+	};
+
+	template<typename T, std::size_t N, bool Const>
+	struct segmented_iterator_traits<unrolled_list_iterator<T, N, Const>> {
+		using iterator = unrolled_list_iterator<T, N, Const>;
+		using is_segmented_iterator = std::true_type;
+		using segment_iterator = unrolled_list_node<T, N>*;
+		using local_iterator = std::conditional_t<Const, const T*, T*>;
+
+		static segment_iterator segment(iterator it) { return it.node; }
+		static local_iterator local(iterator it) { return it.node->data() + it.index; }
+		static local_iterator begin(segment_iterator seg) { return seg->data(); }
+		static local_iterator end(segment_iterator seg) { return seg->data() + seg->count; }
+		static segment_iterator next_segment(segment_iterator seg) { return seg->next; }
+
+		static iterator compose(segment_iterator seg, local_iterator local) {
+			std::size_t index = local - seg->data();
+			// the sentinel is the only node with count 0
+			if (index == seg->count && index != 0)
+				return iterator(seg->next, 0);
+			return iterator(seg, index);
+		}
+	};
+
+	// A doubly linked list of nodes holding up to N elements each in place,
+	// so traversal costs one cache miss per node instead of per element.
+	// Segmented iterators let tests:: algorithms loop over each node's
+	// elements as an array. Splicing is O(1) plus at most one node split;
+	// insert and erase shift at most N elements. Erase keeps every node but
+	// the last at least half full. Inserting or erasing invalidates iterators
+	// into the nodes it touches.
+	template<typename T, std::size_t N = tests::unrolled_list_node_capacity<T>()>
+	class unrolled_list {
+		using node = unrolled_list_node<T, N>;
+
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using difference_type = std::ptrdiff_t;
+		using reference = T&;
+		using const_reference = const T&;
+		using iterator = unrolled_list_iterator<T, N, false>;
+		using const_iterator = unrolled_list_iterator<T, N, true>;
+
+		static_assert(N > 1, "unrolled_list nodes need room for two elements to split");
+
+		unrolled_list() : count(0) {
+			head.prev = head.next = &head;
+			head.count = 0;
+		}
+
+		template<typename InputIt>
+		unrolled_list(InputIt first, InputIt last) : unrolled_list() {
+			for (; first != last; ++first)
+				push_back(*first);
+		}
+
+		unrolled_list(std::initializer_list<T> values) :
+			unrolled_list(values.begin(), values.end()) {
+		}
+
+		unrolled_list(const unrolled_list& other) :
+			unrolled_list(other.begin(), other.end()) {
+		}
+
+		unrolled_list(unrolled_list&& other) : unrolled_list() {
+			splice(end(), other);
+		}
+
+		unrolled_list& operator=(const unrolled_list& other) {
+			if (this != &other) {
+				unrolled_list copy(other);
+				clear();
+				splice(end(), copy);
+			}
+			return *this;
+		}
+
+		unrolled_list& operator=(unrolled_list&& other) {
+			if (this != &other) {
+				clear();
+				splice(end(), other);
+			}
+			return *this;
+		}
+
+		~unrolled_list() {
+			clear();
+		}
+
+		iterator begin() { return iterator(head.next, 0); }
+		iterator end() { return iterator(&head, 0); }
+		const_iterator begin() const { return const_iterator(head.next, 0); }
+		const_iterator end() const { return const_iterator(const_cast<node*>(&head), 0); }
+
+		size_type size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		T& front() { return *begin(); }
+		T& back() { return *--end(); }
+
+		void push_back(const T& x) {
+			node* n = back_node();
+			::new (static_cast<void*>(n->data() + n->count)) T(x);
+			++n->count;
+			++count;
+		}
+
+		void push_back(T&& x) {
+			node* n = back_node();
+			::new (static_cast<void*>(n->data() + n->count)) T(std::move(x));
+			++n->count;
+			++count;
+		}
+
+		void push_front(const T& x) {
+			emplace(begin(), x);
+		}
+
+		void push_front(T&& x) {
+			emplace(begin(), std::move(x));
+		}
+
+		iterator insert(const_iterator pos, const T& x) {
+			return emplace(pos, x);
+		}
+
+		iterator insert(const_iterator pos, T&& x) {
+			return emplace(pos, std::move(x));
+		}
+
+		template<typename... Args>
+		iterator emplace(const_iterator pos, Args&&... args) {
+			// built first: args may refer to an element the insert moves
+			T value(std::forward<Args>(args)...);
+
+			node* n = pos.node;
+			std::size_t i = pos.index;
+			if (i == 0 && n->prev != &head && n->prev->count < N) {
+				// the free tail of the previous node is at pos too
+				n = n->prev;
+				i = n->count;
+			}
+			else if (i == 0 && (n == &head || n->count == N)) {
+				n = link_before(n);
+			}
+			else if (n->count == N) {
+				split(n, N / 2);
+				if (i > N / 2) {
+					n = n->next;
+					i -= N / 2;
+				}
+			}
+
+			T* d = n->data();
+			if (i == n->count) {
+				::new (static_cast<void*>(d + i)) T(std::move(value));
+			}
+			else {
+				::new (static_cast<void*>(d + n->count)) T(std::move(d[n->count - 1]));
+				std::move_backward(d + i, d + n->count - 1, d + n->count);
+				d[i] = std::move(value);
+			}
+			++n->count;
+			++count;
+			return iterator(n, i);
+		}
+
+		iterator erase(const_iterator pos) {
+			node* n = pos.node;
+			std::size_t i = pos.index;
+			T* d = n->data();
+			std::move(d + i + 1, d + n->count, d + i);
+			d[--n->count].~T();
+			--count;
+
+			if (n->count == 0) {
+				node* next = n->next;
+				unlink(n);
+				return iterator(next, 0);
+			}
+			// the element after pos stays at (n, i) or the start of n->next
+			refill(n);
+			if (i == n->count)
+				return iterator(n->next, 0);
+			return iterator(n, i);
+		}
+
+		// moves all of other before pos without copying or moving elements
+		void splice(const_iterator pos, unrolled_list& other) {
+			if (&other == this || other.empty())
+				return;
+
+			node* n = pos.node;
+			if (pos.index != 0) {
+				split(n, pos.index);
+				n = n->next;
+			}
+
+			node* first = other.head.next;
+			node* last = other.head.prev;
+			first->prev = n->prev;
+			n->prev->next = first;
+			last->next = n;
+			n->prev = last;
+			count += other.count;
+
+			other.head.prev = other.head.next = &other.head;
+			other.count = 0;
+		}
+
+		void splice(const_iterator pos, unrolled_list&& other) {
+			splice(pos, other);
+		}
+
+		void clear() {
+			while (head.next != &head) {
+				node* n = head.next;
+				for (std::size_t i = 0; i < n->count; ++i)
+					n->data()[i].~T();
+				unlink(n);
+			}
+			count = 0;
+		}
+
+	private:
+		// the last node with room, appending one if needed
+		node* back_node() {
+			node* n = head.prev;
+			if (n == &head || n->count == N)
+				n = link_before(&head);
+			return n;
+		}
+
+		node* link_before(node* pos) {
+			node* n = new node;
+			n->count = 0;
+			n->prev = pos->prev;
+			n->next = pos;
+			pos->prev->next = n;
+			pos->prev = n;
+			return n;
+		}
+
+		void unlink(node* n) {
+			n->prev->next = n->next;
+			n->next->prev = n->prev;
+			delete n;
+		}
+
+		// Tops up n from the next node once it is under half full: merges the
+		// two when they fit in one node, else moves over half the difference,
+		// which leaves both at least half full.
+		void refill(node* n) {
+			node* next = n->next;
+			if (n->count >= N / 2 || next == &head)
+				return;
+
+			std::size_t moved = n->count + next->count <= N ? next->count
+				: (next->count - n->count) / 2;
+			T* from = next->data();
+			T* to = n->data();
+			for (std::size_t i = 0; i < moved; ++i) {
+				::new (static_cast<void*>(to + n->count)) T(std::move(from[i]));
+				++n->count;
+			}
+			std::move(from + moved, from + next->count, from);
+			for (std::size_t i = next->count - moved; i < next->count; ++i)
+				from[i].~T();
+			next->count -= moved;
+			if (next->count == 0)
+				unlink(next);
+		}
+
+		// moves the elements from index on into a new node after n
+		void split(node* n, std::size_t index) {
+			node* m = link_before(n->next);
+			T* from = n->data();
+			T* to = m->data();
+			for (std::size_t i = index; i < n->count; ++i) {
+				::new (static_cast<void*>(to + m->count)) T(std::move(from[i]));
+				++m->count;
+				from[i].~T();
+			}
+			n->count = index;
+		}
+
+		node head;
+		std::size_t count;
+	};
+}